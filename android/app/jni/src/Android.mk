@@ -12,6 +12,7 @@ LOCAL_C_INCLUDES := $(LOCAL_PATH)/$(SDL_PATH)/include $(LOCAL_PATH)/jnet
 LOCAL_SRC_FILES := \
 	Application.cpp \
 	Apu.cpp \
+	BandLimitedBuffer.cpp \
 	Cartridge.cpp \
 	Controller.cpp \
 	Cpu.cpp \
@@ -35,6 +36,8 @@ LOCAL_SRC_FILES := \
 	OnScreenInput.cpp \
 	Overlay.cpp \
 	Ppu.cpp \
+	Resampler.cpp \
+	Rewind.cpp \
 	SystemInput.cpp
 
 LOCAL_CPPFLAGS := -fexceptions -frtti
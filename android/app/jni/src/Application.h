@@ -1,14 +1,13 @@
 #pragma once
 #include <vector>
-#include <deque>
 #include <string>
 #include <queue>
 #include <unordered_map>
-#include <mutex>
 #include <functional>
 #include <optional>
 #include <cstring>
 #include "Stopwatch.h"
+#include "AudioRing.h"
 #include "InputSource.h"
 
 #if defined(__ANDROID__)
@@ -128,10 +127,13 @@ public:
 	void EnqueueAudio(const std::vector<int16_t>& samples);
 private:
 	static void AudioCallback(void* userdata, uint8_t* stream, int len);
-	std::deque<int16_t> audioBuffer;
-	bool audioStarved = false;
+	// The device reads from the ring on its own thread. Frames are paced a little faster or
+	// slower by how full it is, to hold it near AUDIO_LATENCY seconds.
+	static constexpr float AUDIO_LATENCY = 0.05f;
+	static constexpr float AUDIO_RATE_ADJUST = 0.005f;
+	AudioRing audioRing{ AUDIO_SAMPLE_RATE / 4 };
+	float audioRate = 1.0f;
 	int16_t lastAudioSample = 0;
-	std::mutex audioMtx;
 	std::optional<SDL_AudioDeviceID> audioDevice;
 
 	// Haptics
@@ -1,38 +1,55 @@
 #pragma once
-#include <memory>
 #include <vector>
 #include "Savestate.h"
+#include "Ppu.h"
+#include "ApuChannels.h"
+#include "BandLimitedBuffer.h"
 
-class FrameCounter;
-class PulseChannel;
-class TriangleChannel;
-class NoiseChannel;
 class Nes;
 
 class Apu {
 public:
 	Apu(Nes& nes);
-	Apu(Nes& nes, Savestate& bytes);
-	Savestate SaveState() const;
+	void SaveState(Savestate& state) const;
+	void LoadState(Savestate& state);
 	void Reset();
-	void Clock();
+	void Run(uint64_t dots);
 	uint8_t ReadFromCpu(uint16_t cpuAddress, bool readonly = false);
 	void WriteFromCpu(uint16_t cpuAddress, uint8_t value);
 	bool GetIrq() const;
+	int DotsUntilIrq() const;
 	std::vector<int16_t> TakeSamples();
 private:
-	friend class FrameCounter;
-	int16_t Sample() const;
+	int32_t Mix() const;
+	void UpdateLevel();
 	Nes& nes;
 	bool enabled = false;
 	bool evenFrame = true;
 	float channelVolumes[4];
 	int clockNumber = 0;
-	float time = 0.0f;
+
+	// Run in batches of CPU cycles on which nothing but the timers counting down happens. The
+	// CPU cycle is clocked on the dot clockNumber is 3 at.
+	void ClockCycle();
+	bool ClockFrameCounter();
+	void ClockQuarterFrame();
+	void ClockHalfFrame();
+	uint32_t CyclesUntilClocked() const;
+	void SkipCycles(uint32_t cycles);
+	void AdvanceSampleTime(uint64_t dots);
+
+	// The mixed output only changes when a channel is clocked or written, and each change is
+	// added to the buffer as a step. Time since the last sample counts up by twice the sample
+	// rate every dot, so a sample is due every SAMPLE_PERIOD, twice the dots in a second.
+	static constexpr uint32_t SAMPLE_PERIOD = (Ppu::DOT_COUNT * Ppu::SCANLINE_COUNT * 2 - 1) * 60;
+	uint32_t sampleTime = 0;
+	int32_t level = 0;
+	bool sampling = true;
+	BandLimitedBuffer buffer;
 	std::vector<int16_t> samples;
-	std::shared_ptr<FrameCounter> frameCounter;
-	std::shared_ptr<PulseChannel> pulseChannel1;
-	std::shared_ptr<PulseChannel> pulseChannel2;
-	std::shared_ptr<TriangleChannel> triangleChannel;
-	std::shared_ptr<NoiseChannel> noiseChannel;
+	FrameCounter frameCounter;
+	PulseChannel pulse1{ true };
+	PulseChannel pulse2{ false };
+	TriangleChannel triangle;
+	NoiseChannel noise;
 };
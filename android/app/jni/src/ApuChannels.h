@@ -0,0 +1,501 @@
+#pragma once
+#include <cstdint>
+#include "Savestate.h"
+
+// Channel state is kept flat in plain structs, which Apu clocks directly. Timers and dividers
+// count down to 0 and then reload their period, so they fire every period + 1 clocks. Savestates
+// keep the layout of the object graph the channels used to be built from.
+
+// When the length counter reaches 0, its channel is silenced
+// http://wiki.nesdev.com/w/index.php/APU_Length_Counter
+struct LengthCounter
+{
+	bool enabled = false;
+	bool halt = false;
+	uint8_t counter = 0;
+
+	void SetEnabled(bool enabled) {
+		this->enabled = enabled;
+		if (!enabled)
+			counter = 0;
+	}
+
+	void Load(uint8_t index) {
+		static constexpr uint8_t LENGTHS[32] =
+		{
+			10, 254, 20, 2, 40, 4, 80, 6, 160, 8, 60, 10, 14, 12, 26, 14,
+			12, 16, 24, 18, 48, 20, 96, 22, 192, 24, 72, 26, 16, 28, 32, 30
+		};
+		if (enabled)
+			counter = LENGTHS[index & 0x1F];
+	}
+
+	// Clocked every half frame
+	void Clock() {
+		if (!halt && counter > 0)
+			counter--;
+	}
+
+	void SaveState(Savestate& state) const {
+		state.Push<uint8_t>(enabled);
+		state.Push<uint8_t>(halt);
+		state.PushSize(counter);
+	}
+
+	void LoadState(Savestate& state) {
+		enabled = state.Pop<uint8_t>();
+		halt = state.Pop<uint8_t>();
+		counter = static_cast<uint8_t>(state.PopSize());
+	}
+};
+
+// Decreasing saw with optional looping, or constant volume. The constant volume is also the
+// divider's period.
+// http://wiki.nesdev.com/w/index.php/APU_Envelope
+struct Envelope
+{
+	bool restart = true;
+	bool loop = false;
+	bool constantVolumeMode = false;
+	uint8_t constantVolume = 0;
+	uint8_t divider = 0;
+	uint8_t decay = 0;
+
+	uint8_t GetVolume() const {
+		return constantVolumeMode ? constantVolume : decay;
+	}
+
+	// Clocked every quarter frame
+	void Clock() {
+		if (restart) {
+			restart = false;
+			decay = 15;
+			divider = constantVolume;
+		} else if (divider-- == 0) {
+			divider = constantVolume;
+			if (decay > 0)
+				decay--;
+			else if (loop)
+				decay = 15;
+		}
+	}
+
+	void SaveState(Savestate& state) const {
+		state.PushSize(constantVolume);
+		state.PushSize(divider);
+		state.Push<uint8_t>(restart);
+		state.Push<uint8_t>(loop);
+		state.PushSize(decay);
+		state.Push<uint8_t>(constantVolumeMode);
+		state.PushSize(constantVolume);
+	}
+
+	void LoadState(Savestate& state) {
+		state.PopSize();
+		divider = static_cast<uint8_t>(state.PopSize());
+		restart = state.Pop<uint8_t>();
+		loop = state.Pop<uint8_t>();
+		decay = static_cast<uint8_t>(state.PopSize());
+		constantVolumeMode = state.Pop<uint8_t>();
+		constantVolume = static_cast<uint8_t>(state.PopSize());
+	}
+};
+
+// Timers are saved as the divider and minimum period they used to be built from
+inline void SaveTimerState(Savestate& state, uint16_t period, uint16_t timer, size_t minPeriod) {
+	state.PushSize(period);
+	state.PushSize(timer);
+	state.PushSize(minPeriod);
+}
+
+inline void LoadTimerState(Savestate& state, uint16_t& period, uint16_t& timer) {
+	period = static_cast<uint16_t>(state.PopSize());
+	timer = static_cast<uint16_t>(state.PopSize());
+	state.PopSize();
+}
+
+// Clocks a timer many times at once, and returns how many times it fired
+inline uint32_t SkipTimer(uint16_t& timer, uint16_t period, uint32_t clocks) {
+	if (clocks <= timer) {
+		timer -= static_cast<uint16_t>(clocks);
+		return 0;
+	}
+	clocks -= timer + 1;
+	timer = static_cast<uint16_t>(period - clocks % (period + 1));
+	return 1 + clocks / (period + 1);
+}
+
+// http://wiki.nesdev.com/w/index.php/APU_Pulse
+// http://wiki.nesdev.com/w/index.php/APU_Sweep
+struct PulseChannel
+{
+	uint16_t period = 0;
+	uint16_t timer = 0;
+	uint8_t duty = 0;
+	uint8_t step = 0;
+	LengthCounter length;
+	Envelope envelope;
+
+	// Pulse 1's sweep adder adds the one's complement when negating, so subtracts one more
+	uint8_t sweepSubtractExtra = 0;
+	bool sweepEnabled = false;
+	bool sweepNegate = false;
+	bool sweepReload = false;
+	bool sweepMute = false;
+	uint8_t sweepPeriod = 0;
+	uint8_t sweepDivider = 0;
+	uint8_t sweepShift = 0;
+	uint16_t sweepTarget = 0;
+
+	explicit PulseChannel(bool first) :
+		sweepSubtractExtra(first) {
+	}
+
+	// Returns whether the output may have changed
+	bool ClockTimer() {
+		if (timer-- != 0)
+			return false;
+		timer = period;
+		step = (step + 1) & 7;
+		return true;
+	}
+
+	// Same as clocking the timer that many times
+	void SkipTimer(uint32_t clocks) {
+		step = (step + ::SkipTimer(timer, period, clocks)) & 7;
+	}
+
+	void ClockHalfFrame() {
+		length.Clock();
+
+		ComputeSweepTarget();
+		if (sweepReload) {
+			if (sweepEnabled && sweepDivider == 0)
+				AdjustPeriod();
+			sweepDivider = sweepPeriod;
+			sweepReload = false;
+		} else if (sweepDivider > 0) {
+			sweepDivider--;
+		} else if (sweepEnabled) {
+			sweepDivider = sweepPeriod;
+			AdjustPeriod();
+		}
+	}
+
+	// The target period is only computed on writes to the sweep register and sweep clocks
+	void Write(uint16_t addr, uint8_t data) {
+		switch (addr & 3) {
+		case 0:
+			duty = data >> 6;
+			length.halt = data & 0x20;
+			envelope.loop = data & 0x20;
+			envelope.constantVolumeMode = data & 0x10;
+			envelope.constantVolume = data & 0x0F;
+			break;
+		case 1:
+			sweepEnabled = data & 0x80;
+			sweepPeriod = (data >> 4) & 7;
+			ComputeSweepTarget();
+			sweepNegate = data & 0x08;
+			sweepShift = data & 7;
+			sweepReload = true;
+			break;
+		case 2:
+			period = (period & 0x700) | data;
+			break;
+		case 3:
+			period = ((data & 7) << 8) | (period & 0xFF);
+			timer = period;
+			length.Load(data >> 3);
+			envelope.restart = true;
+			step = 0;
+			break;
+		}
+	}
+
+	uint8_t GetValue() const {
+		static constexpr uint8_t SEQUENCES[4][8] =
+		{
+			{ 0, 1, 0, 0, 0, 0, 0, 0 }, // 12.5%
+			{ 0, 1, 1, 0, 0, 0, 0, 0 }, // 25%
+			{ 0, 1, 1, 1, 1, 0, 0, 0 }, // 50%
+			{ 1, 0, 0, 1, 1, 1, 1, 1 }  // 25% negated
+		};
+		if (sweepMute || length.counter == 0)
+			return 0;
+		return envelope.GetVolume() * SEQUENCES[duty][step];
+	}
+
+	void SaveState(Savestate& state) const {
+		SaveTimerState(state, period, timer, 0);
+		length.SaveState(state);
+		envelope.SaveState(state);
+		state.PushSize(sweepPeriod);
+		state.PushSize(sweepDivider);
+		state.PushSize(sweepSubtractExtra);
+		state.Push<uint8_t>(sweepEnabled);
+		state.Push<uint8_t>(sweepNegate);
+		state.Push<uint8_t>(sweepReload);
+		state.Push<uint8_t>(sweepMute);
+		state.Push<uint8_t>(sweepShift);
+		state.PushSize(sweepTarget);
+		state.Push<uint8_t>(duty);
+		state.Push<uint8_t>(step);
+	}
+
+	void LoadState(Savestate& state) {
+		LoadTimerState(state, period, timer);
+		length.LoadState(state);
+		envelope.LoadState(state);
+		sweepPeriod = static_cast<uint8_t>(state.PopSize());
+		sweepDivider = static_cast<uint8_t>(state.PopSize());
+		sweepSubtractExtra = static_cast<uint8_t>(state.PopSize());
+		sweepEnabled = state.Pop<uint8_t>();
+		sweepNegate = state.Pop<uint8_t>();
+		sweepReload = state.Pop<uint8_t>();
+		sweepMute = state.Pop<uint8_t>();
+		sweepShift = state.Pop<uint8_t>();
+		sweepTarget = static_cast<uint16_t>(state.PopSize());
+		duty = state.Pop<uint8_t>();
+		step = state.Pop<uint8_t>();
+	}
+private:
+	// The channel is muted when the target is out of range, even with the sweep disabled
+	void ComputeSweepTarget() {
+		int shifted = period >> sweepShift;
+		sweepTarget = static_cast<uint16_t>(sweepNegate ? period - (shifted - sweepSubtractExtra) : period + shifted);
+		sweepMute = period < 8 || sweepTarget > 0x7FF;
+	}
+
+	void AdjustPeriod() {
+		if (sweepEnabled && sweepShift > 0 && !sweepMute)
+			period = sweepTarget;
+	}
+};
+
+// Clocked every CPU cycle. The linear counter is clocked every quarter frame, and while either
+// it or the length counter is 0 the sequencer holds its step.
+// http://wiki.nesdev.com/w/index.php/APU_Triangle
+struct TriangleChannel
+{
+	// Periods below this are ultrasonic and only pop, so the timer is stopped
+	static constexpr uint16_t MIN_PERIOD = 2;
+
+	uint16_t period = 0;
+	uint16_t timer = 0;
+	uint8_t step = 0;
+	LengthCounter length;
+	bool linearReload = true;
+	bool linearControl = true;
+	uint8_t linearPeriod = 0;
+	uint8_t linearCounter = 0;
+
+	// Returns whether the output may have changed
+	bool ClockTimer() {
+		if (period < MIN_PERIOD || timer-- != 0)
+			return false;
+		timer = period;
+		if (linearCounter == 0 || length.counter == 0)
+			return false;
+		step = (step + 1) & 31;
+		return true;
+	}
+
+	// Same as clocking the timer that many times, as the counters only change on frame steps
+	void SkipTimer(uint32_t clocks) {
+		if (period < MIN_PERIOD)
+			return;
+		uint32_t fired = ::SkipTimer(timer, period, clocks);
+		if (linearCounter != 0 && length.counter != 0)
+			step = (step + fired) & 31;
+	}
+
+	void ClockQuarterFrame() {
+		if (linearReload)
+			linearCounter = linearPeriod;
+		else if (linearCounter > 0)
+			linearCounter--;
+		if (!linearControl)
+			linearReload = false;
+	}
+
+	void ClockHalfFrame() {
+		length.Clock();
+	}
+
+	void Write(uint16_t addr, uint8_t data) {
+		switch (addr) {
+		case 0x4008:
+			length.halt = data & 0x80;
+			linearControl = data & 0x80;
+			linearPeriod = data & 0x7F;
+			break;
+		case 0x400A:
+			period = (period & 0x700) | data;
+			break;
+		case 0x400B:
+			period = ((data & 7) << 8) | (period & 0xFF);
+			timer = period;
+			linearReload = true;
+			length.Load(data >> 3);
+			break;
+		}
+	}
+
+	uint8_t GetValue() const {
+		static constexpr uint8_t SEQUENCE[32] =
+		{
+			15, 14, 13, 12, 11, 10, 9, 8, 7, 6, 5, 4, 3, 2, 1, 0,
+			0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15
+		};
+		return SEQUENCE[step];
+	}
+
+	void SaveState(Savestate& state) const {
+		SaveTimerState(state, period, timer, MIN_PERIOD);
+		length.SaveState(state);
+		state.PushSize(linearPeriod);
+		state.PushSize(linearCounter);
+		state.Push<uint8_t>(linearReload);
+		state.Push<uint8_t>(linearControl);
+		state.Push<uint8_t>(step);
+	}
+
+	void LoadState(Savestate& state) {
+		LoadTimerState(state, period, timer);
+		length.LoadState(state);
+		linearPeriod = static_cast<uint8_t>(state.PopSize());
+		linearCounter = static_cast<uint8_t>(state.PopSize());
+		linearReload = state.Pop<uint8_t>();
+		linearControl = state.Pop<uint8_t>();
+		step = state.Pop<uint8_t>();
+	}
+};
+
+// The envelope always loops
+// http://wiki.nesdev.com/w/index.php/APU_Noise
+struct NoiseChannel
+{
+	uint16_t period = 0;
+	uint16_t timer = 0;
+	LengthCounter length;
+	Envelope envelope{ .loop = true };
+	uint16_t shiftRegister = 1;
+	bool mode = false;
+
+	// Returns whether the output may have changed
+	bool ClockTimer() {
+		if (timer-- != 0)
+			return false;
+		timer = period;
+		Shift();
+		return true;
+	}
+
+	// Same as clocking the timer that many times
+	void SkipTimer(uint32_t clocks) {
+		for (uint32_t fired = ::SkipTimer(timer, period, clocks); fired > 0; fired--)
+			Shift();
+	}
+
+	void Shift() {
+		uint16_t feedback = (shiftRegister ^ (shiftRegister >> (mode ? 6 : 1))) & 1;
+		shiftRegister = (shiftRegister >> 1) | (feedback << 14);
+	}
+
+	void Write(uint16_t addr, uint8_t data) {
+		// Effective NTSC periods, halved as the timer is clocked every second CPU cycle
+		static constexpr uint16_t PERIODS[16] = { 4, 8, 16, 32, 64, 96, 128, 160, 202, 254, 380, 508, 762, 1016, 2034, 4068 };
+		switch (addr) {
+		case 0x400C:
+			length.halt = data & 0x20;
+			envelope.constantVolumeMode = data & 0x10;
+			envelope.constantVolume = data & 0x0F;
+			break;
+		case 0x400E:
+			mode = data & 0x80;
+			period = PERIODS[data & 0x0F] / 2 - 1;
+			break;
+		case 0x400F:
+			length.Load(data >> 3);
+			envelope.restart = true;
+			break;
+		}
+	}
+
+	uint8_t GetValue() const {
+		if ((shiftRegister & 1) || length.counter == 0)
+			return 0;
+		return envelope.GetVolume();
+	}
+
+	void SaveState(Savestate& state) const {
+		SaveTimerState(state, period, timer, 0);
+		length.SaveState(state);
+		envelope.SaveState(state);
+		state.Push<uint16_t>(shiftRegister);
+		state.Push<uint8_t>(mode);
+	}
+
+	void LoadState(Savestate& state) {
+		LoadTimerState(state, period, timer);
+		length.LoadState(state);
+		envelope.LoadState(state);
+		shiftRegister = state.Pop<uint16_t>();
+		mode = state.Pop<uint8_t>();
+	}
+};
+
+// Counts CPU cycles, clocking the envelopes and linear counter every quarter frame and the
+// length counters and sweeps every half frame, in a sequence of 4 or 5 steps.
+// http://wiki.nesdev.com/w/index.php/APU_Frame_Counter
+struct FrameCounter
+{
+	uint32_t cycles = 0;
+	uint8_t steps = 4;
+	bool inhibitInterrupt = true;
+	bool irq = false;
+
+	// Cycles at which something happens, twice the APU cycles they are usually given in
+	static constexpr uint32_t QUARTER_1 = 7457;
+	static constexpr uint32_t HALF_1 = 14913;
+	static constexpr uint32_t QUARTER_3 = 22371;
+	static constexpr uint32_t IRQ_1 = 29828;
+	static constexpr uint32_t HALF_2 = 29829;
+	static constexpr uint32_t END_4_STEP = 29830;
+	static constexpr uint32_t HALF_2_5_STEP = 37281;
+	static constexpr uint32_t END_5_STEP = 37282;
+
+	// Clock cycles before the next one something happens on, which may be this one
+	uint32_t CyclesUntilStep() const {
+		for (uint32_t step : { QUARTER_1, HALF_1, QUARTER_3, IRQ_1, HALF_2, END_4_STEP, HALF_2_5_STEP, END_5_STEP })
+			if (cycles <= step)
+				return step - cycles;
+		return UINT32_MAX;
+	}
+
+	// Clock cycles until the next one that can raise an interrupt, or -1 if none will
+	int CyclesUntilIrq() const {
+		if (steps != 4 || inhibitInterrupt)
+			return -1;
+		if (cycles <= IRQ_1)
+			return static_cast<int>(IRQ_1 - cycles);
+		if (cycles <= END_4_STEP)
+			return 0;
+		return -1;
+	}
+
+	void SaveState(Savestate& state) const {
+		state.PushSize(cycles);
+		state.PushSize(steps);
+		state.Push<uint8_t>(inhibitInterrupt);
+		state.Push<uint8_t>(irq);
+	}
+
+	void LoadState(Savestate& state) {
+		cycles = static_cast<uint32_t>(state.PopSize());
+		steps = static_cast<uint8_t>(state.PopSize());
+		inhibitInterrupt = state.Pop<uint8_t>();
+		irq = state.Pop<uint8_t>();
+	}
+};
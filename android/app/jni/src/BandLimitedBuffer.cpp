@@ -0,0 +1,53 @@
+#include "BandLimitedBuffer.h"
+#include <algorithm>
+#include <cmath>
+
+// Steps are summed in fixed point with this many fractional bits
+static constexpr int STEP_BITS = 15;
+
+// The impulse each phase of a step is spread out as: a Blackman windowed sinc cut off a little
+// below the Nyquist frequency, rounded so each phase sums to exactly one step.
+static const auto KERNEL = [] {
+	constexpr double PI = 3.14159265358979323846;
+	constexpr double CUTOFF = 0.9;
+	std::array<std::array<int32_t, BandLimitedBuffer::WIDTH>, BandLimitedBuffer::PHASES> kernel{};
+	for (int phase = 0; phase < BandLimitedBuffer::PHASES; phase++) {
+		double taps[BandLimitedBuffer::WIDTH];
+		double total = 0.0;
+		for (int i = 0; i < BandLimitedBuffer::WIDTH; i++) {
+			// Distance of sample i from the step, less the delay
+			double x = i + 1 - double(phase) / BandLimitedBuffer::PHASES - BandLimitedBuffer::WIDTH / 2;
+			double sinc = x == 0.0 ? 1.0 : std::sin(PI * CUTOFF * x) / (PI * CUTOFF * x);
+			double w = (x + BandLimitedBuffer::WIDTH / 2) / BandLimitedBuffer::WIDTH;
+			double window = 0.42 - 0.5 * std::cos(2 * PI * w) + 0.08 * std::cos(4 * PI * w);
+			taps[i] = std::max(0.0, window) * sinc;
+			total += taps[i];
+		}
+		int32_t sum = 0;
+		for (int i = 0; i < BandLimitedBuffer::WIDTH; i++) {
+			kernel[phase][i] = static_cast<int32_t>(std::lround(taps[i] / total * (1 << STEP_BITS)));
+			sum += kernel[phase][i];
+		}
+		kernel[phase][BandLimitedBuffer::WIDTH / 2] += (1 << STEP_BITS) - sum;
+	}
+	return kernel;
+}();
+
+void BandLimitedBuffer::Reset(int32_t level) {
+	steps.fill(0);
+	head = 0;
+	sum = static_cast<int64_t>(level) << STEP_BITS;
+}
+
+void BandLimitedBuffer::AddDelta(int phase, int32_t delta) {
+	const auto& taps = KERNEL[phase];
+	for (int i = 0; i < WIDTH; i++)
+		steps[(head + i) % WIDTH] += static_cast<int64_t>(delta) * taps[i];
+}
+
+int16_t BandLimitedBuffer::ReadSample() {
+	sum += steps[head];
+	steps[head] = 0;
+	head = (head + 1) % WIDTH;
+	return static_cast<int16_t>(std::clamp<int64_t>(sum >> STEP_BITS, INT16_MIN, INT16_MAX));
+}
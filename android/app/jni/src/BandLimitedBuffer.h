@@ -0,0 +1,25 @@
+#pragma once
+#include <array>
+#include <cstdint>
+
+// Turns a level that changes at points in time into samples without aliasing, in the style of a
+// blip buffer. Each change adds a band-limited step spread over the next samples, and reading a
+// sample sums up the steps reaching it. Output is delayed by half the width of a step.
+class BandLimitedBuffer
+{
+public:
+	static constexpr int WIDTH = 16;
+	static constexpr int PHASES = 64;
+
+	// Drops any steps not yet read, with the output settled at level
+	void Reset(int32_t level);
+
+	// Changes the level a fraction phase / PHASES of the way from the last sample read to the next
+	void AddDelta(int phase, int32_t delta);
+	int16_t ReadSample();
+private:
+	// Steps still to be summed into the next WIDTH samples, from head on
+	std::array<int64_t, WIDTH> steps{};
+	int head = 0;
+	int64_t sum = 0;
+};
@@ -20,6 +20,8 @@ struct NesController {
 	void SetState();
 	uint8_t Read();
 	void Update();
+	uint8_t GetShiftRegister() const;
+	void SetShiftRegister(uint8_t value);
 	std::vector<uint8_t> replay;
 	std::vector<uint8_t> history;
 private:
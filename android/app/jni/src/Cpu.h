@@ -9,7 +9,6 @@ class Nes;
 class Cpu {
 public:
 	Cpu(Nes& nes);
-	Cpu(Nes& nes, Savestate& state);
 	Cpu(const Cpu&) = delete;
 	Cpu& operator=(const Cpu&) = delete;
 	void Clock();
@@ -18,12 +17,28 @@ public:
 	void Nmi();
 	void ClockInstruction();
 	bool InstructionComplete() const;
-	Savestate SaveState() const;
+	int PendingCycles() const;
+	void SkipCycles(int cycles);
+	void SaveState(Savestate& state) const;
+	void LoadState(Savestate& state);
+
+	// Everything that decides what the next instructions do, besides memory
+	struct Registers
+	{
+		uint8_t ra, rx, ry, sp, status;
+		uint16_t pc;
+		int cyclesToNextInstruction;
+		bool operator==(const Registers&) const = default;
+	};
+	Registers GetRegisters() const;
+	void SetRegisters(const Registers& registers);
+	uint16_t GetPc() const;
 private:
 	Nes& nes;
 	uint8_t opcode = 0;
 	uint8_t data = 0;
 	uint16_t addr = 0;
+	uint16_t operand = 0;
 	int cyclesToNextInstruction = 0;
 	void ReadAddr();
 	void WriteStack(uint8_t data);
@@ -36,23 +51,33 @@ private:
 	using OpcodeFn = bool(void);
 	using AddrMode = bool(Cpu::*)();
 	using Opcode = bool(Cpu::*)();
-	static struct Instruction
+	using Handler = void(Cpu::*)();
+	struct Instruction
+	{
+		const char* opname;
+		const char* addrname;
+		uint8_t cycles;
+		uint8_t bytes;
+		bool accumulator;
+	};
+	static const Instruction instructions[256];
+	static const Handler handlers[256];
+	static const Handler predecodedHandlers[256];
+	template<AddrMode addrmode, Opcode op, int cycles, bool predecoded>
+	void Execute();
+	static constexpr int AddrModeBytes(AddrMode addrmode);
+	static constexpr int OperandBytes(AddrMode addrmode);
+	uint16_t FetchOperand(uint16_t addr, int bytes);
+
+	// Instructions in PRG ROM decoded on first execution, indexed by PRG offset
+	struct DecodedInstruction
 	{
-		std::string opname;
-		Opcode op = nullptr;
-		std::string addrname;
-		AddrMode addrmode = nullptr;
-		int cycles = 0;
-		int bytes = 0;
-		Instruction() = default;
-		Instruction(
-			std::string opname,
-			Opcode op,
-			std::string addrname,
-			AddrMode addrmode,
-			int cycles
-		);
-	} instructions[256];
+		enum : uint8_t { Empty, Decoded, Uncacheable } state = Empty;
+		uint8_t opcode = 0;
+		uint16_t operand = 0;
+	};
+	std::vector<DecodedInstruction> decodeCache;
+	const DecodedInstruction& Decode(size_t prgOffset);
 
 	// Registers
 	uint8_t ra = 0;
@@ -0,0 +1,61 @@
+#pragma once
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+// Which 256 byte pages of a block of memory were written since an epoch. Each page keeps the
+// epoch it was last written in, so a copy of the memory taken in some epoch can be brought up
+// to date, or put back, by copying only the pages written since.
+class DirtyPages
+{
+public:
+	static constexpr int PAGE_SHIFT = 8;
+	static constexpr size_t PAGE_SIZE = 1 << PAGE_SHIFT;
+
+	// Every page counts as written in the current epoch
+	void Resize(size_t size) {
+		this->size = size;
+		epochs.assign((size + PAGE_SIZE - 1) >> PAGE_SHIFT, epoch);
+	}
+	void SetEpoch(uint32_t epoch) { this->epoch = epoch; }
+	void Mark(size_t offset) { epochs[offset >> PAGE_SHIFT] = epoch; }
+	void MarkAll() { std::fill(epochs.begin(), epochs.end(), epoch); }
+
+	// Copies the pages of memory written since an epoch over a copy taken in it
+	void CopySince(uint32_t since, uint8_t* copy, const uint8_t* memory) const {
+		ForEachSince(since, [&](size_t offset, size_t length) {
+			std::memcpy(copy + offset, memory + offset, length);
+		});
+	}
+
+	// Puts back the pages written since the copy was taken, marking those that differed as written
+	// again. Returns whether any did.
+	bool RestoreSince(uint32_t since, uint8_t* memory, const uint8_t* copy) {
+		bool changed = false;
+		ForEachSince(since, [&](size_t offset, size_t length) {
+			if (std::memcmp(memory + offset, copy + offset, length)) {
+				std::memcpy(memory + offset, copy + offset, length);
+				Mark(offset);
+				changed = true;
+			}
+		});
+		return changed;
+	}
+
+	// Calls f(offset, length) for each page written since an epoch
+	template <class F>
+	void ForEachSince(uint32_t since, F f) const {
+		for (size_t page = 0; page < epochs.size(); page++) {
+			if (epochs[page] < since)
+				continue;
+			size_t offset = page << PAGE_SHIFT;
+			f(offset, std::min(PAGE_SIZE, size - offset));
+		}
+	}
+private:
+
+	std::vector<uint32_t> epochs;
+	size_t size = 0;
+	uint32_t epoch = 0;
+};
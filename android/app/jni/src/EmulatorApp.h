@@ -3,12 +3,14 @@
 #include <deque>
 #include "Application.h"
 #include "Nes.h"
+#include "Rewind.h"
 #include "Menu.h"
 #include "Network.h"
 #include "Stopwatch.h"
 #include "Overlay.h"
 #include "OnScreenInput.h"
 #include "SystemInput.h"
+#include "Resampler.h"
 
 struct EmulatorApp : public Application {
 
@@ -45,6 +47,19 @@ private:
 	int volume = 100;
 	bool paused = false;
 	bool quit = false;
+	bool rewindEnabled = false;
+	Rewind rewind{ 8 << 20 };
+	std::vector<uint8_t> rewindState;
+	Resampler resampler;
+	std::vector<int16_t> audioSamples;
+
+	// Frame skip, see UpdateFrameSkip
+	void UpdateFrameSkip(float cost, bool drawn);
+	static constexpr int MAX_FRAME_SKIP = 3;
+	int frameSkip = 0;
+	int framesSkipped = 0;
+	float drawnFrameCost = 0.0f;
+	float skippedFrameCost = 0.0f;
 	std::deque<std::string> recentRoms;
 	std::string lastFieldValue;
 	Stopwatch<> acbackButtonPressTimer;
@@ -1,3 +1,6 @@
 #pragma once
 
 void RunHeadless(int argc, char** argv);
+
+// Plays every ROM in the Roms folder with Nes::compareCpuCores on, and returns nonzero if any diverge
+int RunCoreComparison(int argc, char** argv);
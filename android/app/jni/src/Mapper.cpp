@@ -1,27 +1,41 @@
 #include "Mapper.h"
 
-Mapper::Mapper(int mapperNumber, int prgChunks, int chrChunks, std::vector<uint8_t>& prg, std::vector<uint8_t>& chr) :
+Mapper::Mapper(int mapperNumber, int prgChunks, int chrChunks, const std::vector<uint8_t>& prg, std::vector<uint8_t>& chr) :
 	prgChunks(prgChunks),
 	chrChunks(chrChunks),
 	mapperNumber(mapperNumber),
 	prg(prg),
 	chr(chr) {
+	InitChrPages();
 }
 
-Mapper::Mapper(Savestate& state, std::vector<uint8_t>& prg, std::vector<uint8_t>& chr) :
-	prg(prg),
-	chr(chr) {
-	mapperNumber = state.Pop<int32_t>();
-	prgChunks = state.Pop<int32_t>();
-	chrChunks = state.Pop<int32_t>();
+// Copies share PRG and CHR with the original and only hold its registers, so SRAM, the page
+// tables, decoded CHR rows and written pages are not copied
+Mapper::Mapper(const Mapper& other) :
+	prg(other.prg),
+	chr(other.chr) {
+	*this = other;
+}
+
+Mapper& Mapper::operator=(const Mapper& other) {
+	mapperNumber = other.mapperNumber;
+	prgChunks = other.prgChunks;
+	chrChunks = other.chrChunks;
+	sramSize = other.sramSize;
+	irq = other.irq;
+	return *this;
 }
 
-Savestate Mapper::SaveState() const {
-	Savestate state;
+void Mapper::SaveState(Savestate& state) const {
 	state.Push<int32_t>(mapperNumber);
 	state.Push<int32_t>(prgChunks);
 	state.Push<int32_t>(chrChunks);
-	return state;
+}
+
+void Mapper::LoadState(Savestate& state) {
+	mapperNumber = state.Pop<int32_t>();
+	prgChunks = state.Pop<int32_t>();
+	chrChunks = state.Pop<int32_t>();
 }
 
 void Mapper::Reset() {
@@ -35,8 +49,9 @@ bool Mapper::MapCpuRead(uint16_t& addr, uint8_t& data, bool readonly) {
 	return MapCpuRead(addr, data);
 }
 
-bool Mapper::MapCpuWrite(uint16_t& addr, uint8_t data) {
-	return MapCpuWrite(addr, data);
+// PRG is ROM, so only mappers with registers take writes
+bool Mapper::MapCpuWrite(uint16_t&, uint8_t) {
+	return false;
 }
 
 bool Mapper::MapCpuRead(uint32_t addr, uint8_t& data) {
@@ -49,43 +64,117 @@ bool Mapper::MapCpuRead(uint32_t addr, uint8_t& data) {
 	return false;
 }
 
-bool Mapper::MapCpuWrite(uint32_t addr, uint8_t data) {
-	if (addr >= 0x8000) {
-		addr -= 0x8000;
-		if (addr < prg.size())
-			prg[addr] = data;
-		return true;
+void Mapper::MapCpuPages(uint16_t addr, size_t size, uint8_t* data, bool writable) {
+	for (size_t offset = 0; offset < size; offset += 0x100) {
+		cpuReadPages[(addr + offset) >> 8] = data + offset;
+		cpuWritePages[(addr + offset) >> 8] = writable ? data + offset : nullptr;
 	}
-	return false;
 }
 
-bool Mapper::MapPpuRead(uint16_t& addr, uint8_t& data, bool readonly) {
-	if (addr < 0x2000) {
-		if (addr < chr.size())
-			data = chr[addr];
-		return true;
+// Banks past the end of PRG wrap around, as the unconnected upper address lines would
+void Mapper::MapPrgPages(uint16_t addr, size_t size, size_t prgOffset) {
+	if (prg.empty()) {
+		UnmapCpuPages(addr, size);
+		return;
+	}
+	for (size_t offset = 0; offset < size; offset += 0x100) {
+		cpuReadPages[(addr + offset) >> 8] = prg.data() + (prgOffset + offset) % prg.size();
+		cpuWritePages[(addr + offset) >> 8] = nullptr;
 	}
-	return false;
 }
 
-bool Mapper::MapPpuWrite(uint16_t& addr, uint8_t data) {
-	if (addr < 0x2000) {
-		if (addr < chr.size())
-			chr[addr] = data;
-		return true;
+// Offset into PRG of the byte mapped at CPU address addr, if it is mapped to PRG
+bool Mapper::GetPrgOffset(uint16_t addr, size_t& offset) const {
+	const uint8_t* page = cpuReadPages[addr >> 8];
+	if (!page || page < prg.data() || page >= prg.data() + prg.size())
+		return false;
+	offset = (page - prg.data()) + (addr & 0xFF);
+	return true;
+}
+
+void Mapper::UnmapCpuPages(uint16_t addr, size_t size) {
+	for (size_t offset = 0; offset < size; offset += 0x100) {
+		cpuReadPages[(addr + offset) >> 8] = nullptr;
+		cpuWritePages[(addr + offset) >> 8] = nullptr;
 	}
-	return false;
 }
 
-MirrorMode Mapper::GetMirrorMode() const {
-	return MirrorMode::Hardwired;
+void Mapper::InitChrPages() {
+	chrRows.resize(chr.size() / 2);
+	chrPages.Resize(chr.size());
+	MapChrPages(0x0000, 0x2000, 0, true);
 }
 
-bool Mapper::GetIrq() const {
-	return false;
+// Banks past the end of CHR are left unmapped and read as 0
+void Mapper::MapChrPages(uint16_t addr, size_t size, size_t chrOffset, bool writable) {
+	for (size_t offset = 0; offset < size; offset += 0x400) {
+		uint8_t* page = chrOffset + offset < chr.size() ? chr.data() + chrOffset + offset : nullptr;
+		chrReadPages[(addr + offset) >> 10] = page;
+		chrWritePages[(addr + offset) >> 10] = writable ? page : nullptr;
+	}
+}
+
+// Offset into CHR of the byte mapped at PPU address addr, which must be below $2000
+bool Mapper::GetChrOffset(uint16_t addr, size_t& offset) const {
+	const uint8_t* page = chrReadPages[addr >> 10];
+	if (!page)
+		return false;
+	offset = (page - chr.data()) + (addr & 0x3FF);
+	return true;
+}
+
+static uint8_t ReverseBits(uint8_t bits) {
+	bits = (bits & 0xF0) >> 4 | (bits & 0x0F) << 4;
+	bits = (bits & 0xCC) >> 2 | (bits & 0x33) << 2;
+	bits = (bits & 0xAA) >> 1 | (bits & 0x55) << 1;
+	return bits;
+}
+
+uint16_t Mapper::ChrRow::Interleave(uint8_t lo, uint8_t hi) {
+	auto spread = [](uint16_t bits) {
+		bits = (bits | bits << 4) & 0x0F0F;
+		bits = (bits | bits << 2) & 0x3333;
+		bits = (bits | bits << 1) & 0x5555;
+		return bits;
+	};
+	return spread(lo) | spread(hi) << 1;
+}
+
+const Mapper::ChrRow& Mapper::GetChrRow(uint16_t addr) {
+	static const ChrRow EMPTY_ROW;
+	size_t offset;
+	if (!GetChrOffset(addr, offset))
+		return EMPTY_ROW;
+
+	auto& row = chrRows[(offset >> 4 << 3) | (offset & 7)];
+	if (!row.decoded) {
+		row.lo = chr[offset];
+		row.hi = chr[offset + 8];
+		row.flippedLo = ReverseBits(row.lo);
+		row.flippedHi = ReverseBits(row.hi);
+		row.pixels = ChrRow::Interleave(row.lo, row.hi);
+		row.decoded = true;
+	}
+	return row;
+}
+
+void Mapper::WriteChr(uint16_t addr, uint8_t data) {
+	uint8_t* page = chrWritePages[addr >> 10];
+	if (!page)
+		return;
+	size_t offset = (page - chr.data()) + (addr & 0x3FF);
+	chr[offset] = data;
+	chrPages.Mark(offset);
+	chrRows[(offset >> 4 << 3) | (offset & 7)].decoded = false;
 }
 
-void Mapper::ClearIrq() {
+void Mapper::InvalidateChrRows() {
+	for (auto& row : chrRows)
+		row.decoded = false;
+}
+
+MirrorMode Mapper::GetMirrorMode() const {
+	return MirrorMode::Hardwired;
 }
 
 void Mapper::CountScanline() {
@@ -95,7 +184,26 @@ const std::vector<uint8_t>& Mapper::GetSram() const {
 	return sram;
 }
 
+std::vector<uint8_t>& Mapper::GetSram() {
+	return sram;
+}
+
 void Mapper::SetSram(std::vector<uint8_t> data) {
 	sram = std::move(data);
 	sram.resize(sramSize);
+	sramPages.Resize(sramSize);
+	if (sramSize)
+		MapCpuPages(0x6000, sramSize, sram.data(), true);
+}
+
+// Into the existing SRAM, which the savestate must have been checked to match in size
+void Mapper::LoadSram(Savestate& state) {
+	state.PopSize();
+	state.PopArray(sram.data(), sram.size());
+	sramPages.MarkAll();
+}
+
+void Mapper::SetEpoch(uint32_t epoch) {
+	chrPages.SetEpoch(epoch);
+	sramPages.SetEpoch(epoch);
 }
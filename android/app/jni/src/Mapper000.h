@@ -1,11 +1,14 @@
 #pragma once
 #include "Mapper.h"
 
-class Mapper000 : public Mapper
+class Mapper000 final : public Mapper
 {
 public:
-	Mapper000(int mapperNumber, int prgChunks, int chrChunks, std::vector<uint8_t>& prg, std::vector<uint8_t>& chr);
-	Mapper000(Savestate& state, std::vector<uint8_t>& prg, std::vector<uint8_t>& chr);
+	Mapper000(int mapperNumber, int prgChunks, int chrChunks, const std::vector<uint8_t>& prg, std::vector<uint8_t>& chr);
 	bool MapCpuRead(uint16_t& addr, uint8_t& data, bool readonly = false) override;
 	bool MapCpuWrite(uint16_t& addr, uint8_t data) override;
+	std::unique_ptr<Mapper> Clone() const override;
+	void CopyState(const Mapper& other) override;
+private:
+	void UpdatePages();
 };
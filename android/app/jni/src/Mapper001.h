@@ -1,20 +1,20 @@
 #pragma once
 #include "Mapper.h"
 
-class Mapper001 : public Mapper
+class Mapper001 final : public Mapper
 {
 public:
-	Mapper001(int mapperNumber, int prgChunks, int chrChunks, std::vector<uint8_t>& prg, std::vector<uint8_t>& chr);
-	Mapper001(Savestate& state, std::vector<uint8_t>& prg, std::vector<uint8_t>& chr);
+	Mapper001(int mapperNumber, int prgChunks, int chrChunks, const std::vector<uint8_t>& prg, std::vector<uint8_t>& chr);
 	bool MapCpuRead(uint16_t& addr, uint8_t& data, bool readonly = false) override;
 	bool MapCpuWrite(uint16_t& addr, uint8_t data) override;
-	bool MapPpuRead(uint16_t& addr, uint8_t& data, bool readonly = false) override;
-	bool MapPpuWrite(uint16_t& addr, uint8_t data) override;
-	Savestate SaveState() const override;
+	void SaveState(Savestate& state) const override;
+	void LoadState(Savestate& state) override;
 	void Reset() override;
 	MirrorMode GetMirrorMode() const override;
+	std::unique_ptr<Mapper> Clone() const override;
+	void CopyState(const Mapper& other) override;
 private:
-	bool MapPpuAddr(uint16_t& addr, uint32_t& newAddr) const;
+	void UpdatePages();
 	uint8_t shift;
 	uint8_t chrLo;
 	uint8_t chrHi;
@@ -1,16 +1,19 @@
 #pragma once
 #include "Mapper.h"
 
-class Mapper002 : public Mapper
+class Mapper002 final : public Mapper
 {
 public:
-	Mapper002(int mapperNumber, int prgChunks, int chrChunks, std::vector<uint8_t>& prg, std::vector<uint8_t>& chr);
-	Mapper002(Savestate& state, std::vector<uint8_t>& prg, std::vector<uint8_t>& chr);
+	Mapper002(int mapperNumber, int prgChunks, int chrChunks, const std::vector<uint8_t>& prg, std::vector<uint8_t>& chr);
 	bool MapCpuRead(uint16_t& addr, uint8_t& data, bool readonly = false) override;
 	bool MapCpuWrite(uint16_t& addr, uint8_t data) override;
-	Savestate SaveState() const override;
+	void SaveState(Savestate& state) const override;
+	void LoadState(Savestate& state) override;
 	void Reset() override;
+	std::unique_ptr<Mapper> Clone() const override;
+	void CopyState(const Mapper& other) override;
 private:
+	void UpdatePages();
 	uint8_t loPrgBank;
 	uint8_t hiPrgBank;
 };
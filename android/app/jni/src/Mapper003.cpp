@@ -1,24 +1,26 @@
 #include "Mapper003.h"
 
-Mapper003::Mapper003(int mapperNumber, int prgChunks, int chrChunks, std::vector<uint8_t>& prg, std::vector<uint8_t>& chr) :
+Mapper003::Mapper003(int mapperNumber, int prgChunks, int chrChunks, const std::vector<uint8_t>& prg, std::vector<uint8_t>& chr) :
 	Mapper(mapperNumber, prgChunks, chrChunks, prg, chr),
 	chrBank(0) {
+	UpdatePages();
 }
 
-Mapper003::Mapper003(Savestate& state, std::vector<uint8_t>& prg, std::vector<uint8_t>& chr) :
-	Mapper(state, prg, chr) {
+void Mapper003::LoadState(Savestate& state) {
+	Mapper::LoadState(state);
 	chrBank = state.Pop<int32_t>();
 	chrBank &= 0b11;
+	UpdatePages();
 }
 
-Savestate Mapper003::SaveState() const {
-	Savestate state = Mapper::SaveState();
+void Mapper003::SaveState(Savestate& state) const {
+	Mapper::SaveState(state);
 	state.Push<int32_t>(chrBank);
-	return state;
 }
 
 void Mapper003::Reset() {
 	chrBank = 0;
+	UpdatePages();
 }
 
 bool Mapper003::MapCpuRead(uint16_t& addr, uint8_t& data, bool readonly) {
@@ -31,22 +33,24 @@ bool Mapper003::MapCpuRead(uint16_t& addr, uint8_t& data, bool readonly) {
 }
 
 bool Mapper003::MapCpuWrite(uint16_t& addr, uint8_t data) {
-	if (addr >= 0x8000)
+	if (addr >= 0x8000) {
 		chrBank = data & 0b11;
+		UpdatePages();
+	}
 	return false;
 }
 
-bool Mapper003::MapPpuRead(uint16_t& addr, uint8_t& data, bool readonly) {
-	if (addr < 0x2000) {
-		auto newAddr = (chrBank * 0x2000) + (addr & 0x1FFF);
-		if (newAddr < chr.size()) {
-			data = chr[newAddr];
-			return true;
-		}
-	}
-	return false;
+std::unique_ptr<Mapper> Mapper003::Clone() const {
+	return std::make_unique<Mapper003>(*this);
 }
 
-bool Mapper003::MapPpuWrite(uint16_t& addr, uint8_t data) {
-	return false;
+void Mapper003::CopyState(const Mapper& other) {
+	*this = static_cast<const Mapper003&>(other);
+	UpdatePages();
+}
+
+void Mapper003::UpdatePages() {
+	MapPrgPages(0x8000, 0x4000, 0);
+	MapPrgPages(0xC000, 0x4000, prgChunks > 1 ? 0x4000 : 0);
+	MapChrPages(0x0000, 0x2000, chrBank * 0x2000, false);
 }
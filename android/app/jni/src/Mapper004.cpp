@@ -1,6 +1,6 @@
 #include "Mapper004.h"
 
-Mapper004::Mapper004(int mapperNumber, int prgChunks, int chrChunks, std::vector<uint8_t>& prg, std::vector<uint8_t>& chr) :
+Mapper004::Mapper004(int mapperNumber, int prgChunks, int chrChunks, const std::vector<uint8_t>& prg, std::vector<uint8_t>& chr) :
 	Mapper(mapperNumber, prgChunks, chrChunks, prg, chr),
 	lastPrgBankNumber(prgChunks * 2 - 1) {
 	sramSize = 0x2000;
@@ -8,24 +8,21 @@ Mapper004::Mapper004(int mapperNumber, int prgChunks, int chrChunks, std::vector
 	Reset();
 }
 
-Mapper004::Mapper004(Savestate& state, std::vector<uint8_t>& prg, std::vector<uint8_t>& chr) :
-	Mapper(state, prg, chr),
-	lastPrgBankNumber(prgChunks * 2 - 1) {
-	sramSize = 0x2000;
-	sram.resize(sramSize);
-
+void Mapper004::LoadState(Savestate& state) {
+	Mapper::LoadState(state);
 	state.PopArray(regs, sizeof(regs));
 	bankSelect = state.Pop<decltype(bankSelect)>();
 	mirrorMode = state.Pop<MirrorMode>();
 	irqCounter = state.Pop<int32_t>();
 	irqReload = state.Pop<int32_t>();
 	irqEnabled = state.Pop<uint8_t>();
-	irqState = state.Pop<uint8_t>();
+	irq = state.Pop<uint8_t>();
 	reloadPending = state.Pop<uint8_t>();
+	UpdatePages();
 }
 
-Savestate Mapper004::SaveState() const {
-	Savestate state = Mapper::SaveState();
+void Mapper004::SaveState(Savestate& state) const {
+	Mapper::SaveState(state);
 
 	state.PushArray(regs, sizeof(regs));
 	state.Push<decltype(bankSelect)>(bankSelect);
@@ -33,10 +30,9 @@ Savestate Mapper004::SaveState() const {
 	state.Push<int32_t>(irqCounter);
 	state.Push<int32_t>(irqReload);
 	state.Push<uint8_t>(irqEnabled);
-	state.Push<uint8_t>(irqState);
+	state.Push<uint8_t>(irq);
 	state.Push<uint8_t>(reloadPending);
 
-	return state;
 }
 
 void Mapper004::Reset() {
@@ -45,9 +41,10 @@ void Mapper004::Reset() {
 	irqCounter = 0;
 	irqReload = 0;
 	irqEnabled = false;
-	irqState = false;
+	irq = false;
 	reloadPending = false;
 	mirrorMode = MirrorMode::Hardwired;
+	UpdatePages();
 }
 
 MirrorMode Mapper004::GetMirrorMode() const {
@@ -82,6 +79,7 @@ bool Mapper004::MapCpuWrite(uint16_t& addr, uint8_t data) {
 	bool evenAddr = addr % 2 == 0;
 	if (addr >= 0x6000 && addr < 0x8000) {
 		sram[addr - 0x6000] = data;
+		GetSramPages().Mark(addr - 0x6000);
 		return true;
 	} else if (addr >= 0x8000 && addr < 0xA000) {
 		if (evenAddr)
@@ -94,6 +92,7 @@ bool Mapper004::MapCpuWrite(uint16_t& addr, uint8_t data) {
 				data &= 0b0011'1111;
 			regs[n] = data;
 		}
+		UpdatePages();
 	} else if (addr >= 0xA000 && addr < 0xC000) {
 		if (evenAddr)
 			mirrorMode = (data & 1) ? MirrorMode::Horizontal : MirrorMode::Vertical;
@@ -108,70 +107,49 @@ bool Mapper004::MapCpuWrite(uint16_t& addr, uint8_t data) {
 	} else if (addr >= 0xE000) {
 		if (evenAddr) {
 			irqEnabled = false;
-			irqState = false;
+			irq = false;
 		} else
 			irqEnabled = true;
 	}
 	return false;
 }
 
-bool Mapper004::MapPpuAddr(uint16_t& addr, uint32_t& newAddr) const {
-	newAddr = addr;
-	if (addr < 0x2000) {
-		if (bankSelect.chrMode == 0) {
-			if (addr < 0x1000)
-				newAddr = (regs[addr >= 0x800] * 0x400) + (addr & 0x7FF);
-			else
-				newAddr = (regs[(addr - 0x1000) / 0x400 + 2] * 0x400) + (addr & 0x3FF);
-		} else {
-			if (addr >= 0x1000)
-				newAddr = (regs[(addr - 0x1000) >= 0x800] * 0x400) + (addr & 0x7FF);
-			else
-				newAddr = (regs[addr / 0x400 + 2] * 0x400) + (addr & 0x3FF);
-		}
-		return true;
-	}
-	return false;
-}
-
-bool Mapper004::MapPpuRead(uint16_t& addr, uint8_t& data, bool readonly) {
-	uint32_t newAddr;
-	if (MapPpuAddr(addr, newAddr)) {
-		if (newAddr < chr.size())
-			data = chr[newAddr];
-		return true;
-	}
-	return false;
+std::unique_ptr<Mapper> Mapper004::Clone() const {
+	return std::make_unique<Mapper004>(*this);
 }
 
-bool Mapper004::MapPpuWrite(uint16_t& addr, uint8_t data) {
-	uint32_t newAddr;
-	if (MapPpuAddr(addr, newAddr)) {
-		if (newAddr < chr.size())
-			chr[newAddr] = data;
-		return true;
-	}
-	return false;
+void Mapper004::CopyState(const Mapper& other) {
+	*this = static_cast<const Mapper004&>(other);
+	UpdatePages();
 }
 
-
-bool Mapper004::GetIrq() const {
-	return irqState;
+void Mapper004::UpdatePages() {
+	int swappable = bankSelect.prgMode ? lastPrgBankNumber - 1 : regs[6];
+	int fixed = bankSelect.prgMode ? regs[6] : lastPrgBankNumber - 1;
+	MapPrgPages(0x8000, 0x2000, swappable * 0x2000);
+	MapPrgPages(0xA000, 0x2000, regs[7] * 0x2000);
+	MapPrgPages(0xC000, 0x2000, fixed * 0x2000);
+	MapPrgPages(0xE000, 0x2000, lastPrgBankNumber * 0x2000);
+
+	// 2KB banks go in the half selected by chrMode, 1KB banks in the other
+	uint16_t chr2k = bankSelect.chrMode ? 0x1000 : 0x0000;
+	uint16_t chr1k = bankSelect.chrMode ? 0x0000 : 0x1000;
+	MapChrPages(chr2k, 0x800, regs[0] * 0x400, true);
+	MapChrPages(chr2k + 0x800, 0x800, regs[1] * 0x400, true);
+	for (int i = 0; i < 4; i++)
+		MapChrPages(chr1k + i * 0x400, 0x400, regs[i + 2] * 0x400, true);
 }
 
-void Mapper004::ClearIrq() {
-	irqState = false;
-}
 
 void Mapper004::CountScanline() {
 	if (reloadPending || irqCounter <= 0) {
 		reloadPending = false;
 		irqCounter = irqReload;
 		if (irqCounter == 0)
-			irqState = true;
+			irq = true;
 	} else {
 		irqCounter--;
 		if (irqCounter <= 0 && irqEnabled)
-			irqState = true;
+			irq = true;
 	}
 }
@@ -1,27 +1,28 @@
 #include "Mapper007.h"
 
-Mapper007::Mapper007(int mapperNumber, int prgChunks, int chrChunks, std::vector<uint8_t>& prg, std::vector<uint8_t>& chr) :
+Mapper007::Mapper007(int mapperNumber, int prgChunks, int chrChunks, const std::vector<uint8_t>& prg, std::vector<uint8_t>& chr) :
 	Mapper(mapperNumber, prgChunks, chrChunks, prg, chr) {
 	Reset();
 }
 
-Mapper007::Mapper007(Savestate& state, std::vector<uint8_t>& prg, std::vector<uint8_t>& chr) :
-	Mapper(state, prg, chr) {
+void Mapper007::LoadState(Savestate& state) {
+	Mapper::LoadState(state);
 	prgBank = state.Pop<int32_t>();
 	prgBank &= 0b1111;
 	mirrorMode = state.Pop<MirrorMode>();
+	UpdatePages();
 }
 
-Savestate Mapper007::SaveState() const {
-	auto state = Mapper::SaveState();
+void Mapper007::SaveState(Savestate& state) const {
+	Mapper::SaveState(state);
 	state.Push<int32_t>(prgBank);
 	state.Push<MirrorMode>(mirrorMode);
-	return state;
 }
 
 void Mapper007::Reset() {
 	prgBank = prgChunks / 2 - 1;
 	mirrorMode = MirrorMode::OneScreenLo;
+	UpdatePages();
 }
 
 bool Mapper007::MapCpuRead(uint16_t& addr, uint8_t& data, bool readonly) {
@@ -37,10 +38,24 @@ bool Mapper007::MapCpuWrite(uint16_t& addr, uint8_t data) {
 	if (addr >= 0x8000) {
 		prgBank = data & 0b1111;
 		mirrorMode = (data & 0b0001'0000) ? MirrorMode::OneScreenHi : MirrorMode::OneScreenLo;
+		UpdatePages();
 	}
 	return false;
 }
 
+std::unique_ptr<Mapper> Mapper007::Clone() const {
+	return std::make_unique<Mapper007>(*this);
+}
+
+void Mapper007::CopyState(const Mapper& other) {
+	*this = static_cast<const Mapper007&>(other);
+	UpdatePages();
+}
+
+void Mapper007::UpdatePages() {
+	MapPrgPages(0x8000, 0x8000, prgBank * 0x8000);
+}
+
 MirrorMode Mapper007::GetMirrorMode() const {
 	return mirrorMode;
 }
@@ -1,28 +1,29 @@
 #include "Mapper066.h"
 
-Mapper066::Mapper066(int mapperNumber, int prgChunks, int chrChunks, std::vector<uint8_t>& prg, std::vector<uint8_t>& chr) :
+Mapper066::Mapper066(int mapperNumber, int prgChunks, int chrChunks, const std::vector<uint8_t>& prg, std::vector<uint8_t>& chr) :
 	Mapper(mapperNumber, prgChunks, chrChunks, prg, chr) {
 	Reset();
 }
 
-Mapper066::Mapper066(Savestate& state, std::vector<uint8_t>& prg, std::vector<uint8_t>& chr) :
-	Mapper(state, prg, chr) {
+void Mapper066::LoadState(Savestate& state) {
+	Mapper::LoadState(state);
 	prgBank = state.Pop<int32_t>();
 	prgBank &= 0b11;
 	chrBank = state.Pop<int32_t>();
 	chrBank &= 0b11;
+	UpdatePages();
 }
 
-Savestate Mapper066::SaveState() const {
-	auto state = Mapper::SaveState();
+void Mapper066::SaveState(Savestate& state) const {
+	Mapper::SaveState(state);
 	state.Push<int32_t>(prgBank);
 	state.Push<int32_t>(chrBank);
-	return state;
 }
 
 void Mapper066::Reset() {
 	prgBank = 0;
 	chrBank = 0;
+	UpdatePages();
 }
 
 bool Mapper066::MapCpuRead(uint16_t& addr, uint8_t& data, bool readonly) {
@@ -38,21 +39,21 @@ bool Mapper066::MapCpuWrite(uint16_t& addr, uint8_t data) {
 	if (addr >= 0x8000) {
 		prgBank = (data >> 4) & 0b11;
 		chrBank = data & 0b11;
+		UpdatePages();
 	}
 	return false;
 }
 
-bool Mapper066::MapPpuRead(uint16_t& addr, uint8_t& data, bool readonly) {
-	if (addr < 0x2000) {
-		auto newAddr = chrBank * 0x2000 + (addr & 0x1FFF);
-		if (newAddr < chr.size()) {
-			data = chr[newAddr];
-			return true;
-		}
-	}
-	return false;
+std::unique_ptr<Mapper> Mapper066::Clone() const {
+	return std::make_unique<Mapper066>(*this);
 }
 
-bool Mapper066::MapPpuWrite(uint16_t& addr, uint8_t data) {
-	return false;
+void Mapper066::CopyState(const Mapper& other) {
+	*this = static_cast<const Mapper066&>(other);
+	UpdatePages();
+}
+
+void Mapper066::UpdatePages() {
+	MapPrgPages(0x8000, 0x8000, prgBank * 0x8000);
+	MapChrPages(0x0000, 0x2000, chrBank * 0x2000, false);
 }
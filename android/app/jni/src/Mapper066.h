@@ -1,18 +1,19 @@
 #pragma once
 #include "Mapper.h"
 
-class Mapper066 : public Mapper
+class Mapper066 final : public Mapper
 {
 public:
-	Mapper066(int mapperNumber, int prgChunks, int chrChunks, std::vector<uint8_t>& prg, std::vector<uint8_t>& chr);
-	Mapper066(Savestate& state, std::vector<uint8_t>& prg, std::vector<uint8_t>& chr);
+	Mapper066(int mapperNumber, int prgChunks, int chrChunks, const std::vector<uint8_t>& prg, std::vector<uint8_t>& chr);
 	bool MapCpuRead(uint16_t& addr, uint8_t& data, bool readonly = false) override;
 	bool MapCpuWrite(uint16_t& addr, uint8_t data) override;
-	bool MapPpuRead(uint16_t& addr, uint8_t& data, bool readonly = false) override;
-	bool MapPpuWrite(uint16_t& addr, uint8_t data) override;
-	Savestate SaveState() const override;
+	void SaveState(Savestate& state) const override;
+	void LoadState(Savestate& state) override;
 	void Reset() override;
+	std::unique_ptr<Mapper> Clone() const override;
+	void CopyState(const Mapper& other) override;
 private:
+	void UpdatePages();
 	int prgBank;
 	int chrBank;
 };
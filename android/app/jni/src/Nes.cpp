@@ -1,4 +1,5 @@
 #include "Nes.h"
+#include <algorithm>
 
 struct NesColour {
 	uint8_t r, g, b;
@@ -76,63 +77,88 @@ Nes::Nes() :
 	oam{}
 {
 	screenBuffer.resize(Ppu::DRAWABLE_WIDTH * Ppu::DRAWABLE_HEIGHT, 0xF);
+	ramPages.Resize(sizeof(ram));
 
 	controllers[0] = std::make_unique<NesController>(NULL_INPUT_SOURCE);
 	controllers[1] = std::make_unique<NesController>(NULL_INPUT_SOURCE);
 }
 
+// The whole savestate is checked before anything is changed, so an invalid one leaves everything
+// as it was. Savestates of the inserted ROM are loaded in place, and older ones storing their own
+// ROM replace the cartridge.
 bool Nes::LoadState(Savestate& state) {
+	if (!cart)
+		return false;
 
-	auto GetFilenameFromPath = [](const std::string& path) {
-		return path.substr(path.find_last_of("/\\") + 1);
-	};
-
-	Savestate backup;
-	bool restore = (bool)cart;
-	if (restore) {
-		backup = SaveState();
-	}
-
+	std::shared_ptr<Cartridge> storedCart;
+	size_t cartSize;
 	try {
-		cpu = std::make_unique<Cpu>(*this, state);
-		cart = std::make_shared<Cartridge>(state);
-		ppu = std::make_unique<Ppu>(*this, cart.get(), state);
-		apu = std::make_shared<Apu>(*this, state);
-
-		state.PopArray(ram, sizeof(ram));
-		state.PopArray(oam, sizeof(oam));
-
-		oamAddr = state.Pop<uint8_t>();
-		dmaAddr = state.Pop<uint16_t>();
-		dmaData = state.Pop<uint8_t>();
-		dmaReady = state.Pop<uint8_t>();
-		dmaMode = state.Pop<uint8_t>();
-		controllerLatch = state.Pop<uint8_t>();
-		clockNumber = state.Pop<int32_t>();
-
-		if (state.size())
-			throw InvalidFileException("Invalid savestate (trailing data).");
-
-		return true;
-
+		Savestate check = state.Peek();
+		check.Skip(Savestate::Measure([&](Savestate& s) { cpu->SaveState(s); }));
+		Savestate cartState = check.Peek();
+		if (!cart->ValidateState(check)) {
+			check = cartState.Peek();
+			storedCart = std::make_shared<Cartridge>(check, cart.get());
+		}
+		cartSize = cartState.size() - check.size();
+		if (check.size() != Savestate::Measure([&](Savestate& s) { SaveStateAfterCartridge(s); }))
+			throw InvalidFileException("Invalid savestate (wrong size).");
 	} catch (InvalidFileException&) {
-		if (restore)
-			LoadState(backup);
 		return false;
 	}
+
+	cpu->LoadState(state);
+	if (storedCart) {
+		state.Skip(cartSize);
+		cart = std::move(storedCart);
+		UseMapper(cart->GetMapper());
+		ppu.emplace(*this, cart.get());
+		runAheadSnapshot.reset();
+	} else {
+		cart->LoadState(state);
+	}
+	LoadStateAfterCartridge(state);
+
+	ppuTimestamp = apuTimestamp = timestamp;
+	busAccesses++;
+	runAheadSamples.clear();
+	return true;
 }
 
 Savestate Nes::SaveState() const {
 	if (!cart)
 		throw std::logic_error("Attempted to save without a cartridge loaded.");
 
+	// Sized by the previous save, as a cartridge's states are mostly the same size
 	Savestate state;
-	state.PushState(cpu->SaveState());
-	state.PushState(cart->SaveState());
-	state.PushState(ppu->SaveState());
-	state.PushState(apu->SaveState());
+	state.Reserve(lastStateSize);
+	cpu->SaveState(state);
+	cart->SaveState(state);
+	SaveStateAfterCartridge(state);
+	lastStateSize = state.GetBuffer().size();
+	return state;
+}
+
+// Starts an epoch and writes over the savestate saved in the epoch since, which should be the
+// one returned by the previous save. RAM, CHR and SRAM are only rewritten on the pages written
+// since, see DirtyPages. Returns the epoch to pass in next time.
+uint32_t Nes::SaveStateSince(Savestate& state) {
+	if (!cart)
+		throw std::logic_error("Attempted to save without a cartridge loaded.");
+
+	uint32_t saved = BeginEpoch();
+	cpu->SaveState(state);
+	cart->SaveState(state);
+	SaveStateAfterCartridge(state);
+	return saved;
+}
 
-	state.PushArray(ram, sizeof(ram));
+// Everything after the cartridge, which is the same size in every savestate
+void Nes::SaveStateAfterCartridge(Savestate& state) const {
+	ppu->SaveState(state);
+	apu->SaveState(state);
+
+	state.PushPages(ram, sizeof(ram), ramPages);
 	state.PushArray(oam, sizeof(oam));
 
 	state.Push<uint8_t>(oamAddr);
@@ -142,7 +168,24 @@ Savestate Nes::SaveState() const {
 	state.Push<uint8_t>(dmaMode);
 	state.Push<uint8_t>(controllerLatch);
 	state.Push<int32_t>(clockNumber);
-	return state;
+}
+
+void Nes::LoadStateAfterCartridge(Savestate& state) {
+	ppu->LoadState(state);
+	apu->LoadState(state);
+
+	state.PopArray(ram, sizeof(ram));
+	ramPages.MarkAll();
+	state.PopArray(oam, sizeof(oam));
+	spriteIndexValid = false;
+
+	oamAddr = state.Pop<uint8_t>();
+	dmaAddr = state.Pop<uint16_t>();
+	dmaData = state.Pop<uint8_t>();
+	dmaReady = state.Pop<uint8_t>();
+	dmaMode = state.Pop<uint8_t>();
+	controllerLatch = state.Pop<uint8_t>();
+	clockNumber = state.Pop<int32_t>();
 }
 
 void Nes::Reset() {
@@ -155,13 +198,19 @@ void Nes::Reset() {
 void Nes::InsertCartridge(std::unique_ptr<Cartridge> cart) {
 	if (cart) {
 		this->cart = std::move(cart);
+		UseMapper(this->cart->GetMapper());
 
-		cpu = std::make_unique<Cpu>(*this);
-		ppu = std::make_unique<Ppu>(*this, this->cart.get());
-		apu = std::make_unique<Apu>(*this);
+		cpu.emplace(*this);
+		ppu.emplace(*this, this->cart.get());
+		apu.emplace(*this);
 
 		clockNumber = 0;
+		timestamp = ppuTimestamp = apuTimestamp = 0;
+		busAccesses++;
+		runAheadSnapshot.reset();
+		runAheadSamples.clear();
 		std::memset(ram, 0, std::size(ram));
+		ramPages.MarkAll();
 
 		this->cart->Reset();
 		ppu->Reset();
@@ -170,7 +219,10 @@ void Nes::InsertCartridge(std::unique_ptr<Cartridge> cart) {
 		cpu.reset();
 		ppu.reset();
 		apu.reset();
+		runAheadSnapshot.reset();
+		runAheadSamples.clear();
 		this->cart.reset();
+		mapper = nullptr;
 	}
 }
 
@@ -184,25 +236,43 @@ void Nes::UnplugController(int port) {
 	SetController(port, nullptr);
 }
 
+// Dots from the start of a dot until the CPU is next clocked, indexed by clockNumber
+static constexpr int DOTS_UNTIL_CPU[7] = { 3, 2, 1, 0, 2, 1, 0 };
+
 void Nes::Clock() {
-	ppu->Clock();
-	apu->Clock();
-	if (clockNumber == 3 || clockNumber == 6) {
-		if (clockNumber == 6)
-			clockNumber = 0;
-		if (dmaMode)
-			ClockDMA();
-		else
-			cpu->Clock();
-	}
+	ClockEvent();
+	SyncApu();
+}
+
+// Clocks a dot, leaving the APU behind unless its interrupt is due
+void Nes::ClockEvent() {
+	timestamp++;
+	SyncPpu();
+	if (apuTimestamp + apu->DotsUntilIrq() <= timestamp)
+		SyncApu();
+	if (clockNumber == 3 || clockNumber == 6)
+		ClockCpu();
 	clockNumber++;
 
+	PollInterrupts();
+}
+
+void Nes::ClockCpu() {
+	if (clockNumber == 6)
+		clockNumber = 0;
+	if (dmaMode)
+		ClockDMA();
+	else
+		cpu->Clock();
+}
+
+void Nes::PollInterrupts() {
 	if (ppu->CheckNmi())
 		cpu->Nmi();
 
 	bool irq = false;
-	if (cart->GetMapper().GetIrq()) {
-		cart->GetMapper().ClearIrq();
+	if (mapper->GetIrq()) {
+		mapper->ClearIrq();
 		irq = true;
 	}
 	if (apu->GetIrq())
@@ -216,6 +286,93 @@ void Nes::Clock() {
 			controller->SetState();
 }
 
+void Nes::SyncPpu() {
+	if (ppuTimestamp < timestamp) {
+		ppu->Run(timestamp - ppuTimestamp);
+		ppuTimestamp = timestamp;
+	}
+}
+
+void Nes::SyncApu() {
+	if (apuTimestamp < timestamp) {
+		apu->Run(timestamp - apuTimestamp);
+		apuTimestamp = timestamp;
+	}
+}
+
+void Nes::AdvanceTo(uint64_t target) {
+	uint64_t dots = target - timestamp;
+	if (dots == 0)
+		return;
+	if (clockNumber == 0) {
+		clockNumber = 1;
+		dots--;
+	}
+	clockNumber = (int)((clockNumber - 1 + dots) % 6) + 1;
+	timestamp = target;
+}
+
+uint64_t Nes::NextEventTimestamp() const {
+	return std::min(ppuTimestamp + ppu->DotsUntilEvent(), apuTimestamp + apu->DotsUntilIrq());
+}
+
+// Runs the CPU up to and including dot target while the PPU and APU lag behind. Nothing the CPU
+// observes can change before the next event unless it touches the PPU or APU, which syncs them.
+// Only the APU and controllers are polled here, as the PPU and mapper can't raise an interrupt
+// until they are clocked.
+void Nes::RunUntil(uint64_t target) {
+	while (timestamp < target) {
+		uint64_t cpuTimestamp = timestamp + 1 + DOTS_UNTIL_CPU[clockNumber];
+		if (!dmaMode) {
+			uint64_t pending = cpu->PendingCycles();
+			if (cpuTimestamp + 3 * pending > target) {
+				if (cpuTimestamp <= target)
+					cpu->SkipCycles((int)((target - cpuTimestamp) / 3 + 1));
+				AdvanceTo(target);
+				return;
+			}
+			cpu->SkipCycles((int)pending);
+			cpuTimestamp += 3 * pending;
+		} else if (cpuTimestamp > target) {
+			AdvanceTo(target);
+			return;
+		}
+
+		AdvanceTo(cpuTimestamp - 1);
+		timestamp++;
+		bool executed = !dmaMode;
+		uint16_t pc = cpu->GetPc();
+		ClockCpu();
+		clockNumber++;
+
+		if (apu->GetIrq())
+			cpu->Irq();
+
+		if (controllerLatch & 1)
+			for (auto& controller : controllers)
+				controller->SetState();
+
+		if (skipIdleLoops && executed && cpu->GetPc() <= pc)
+			SkipIdleLoop(target);
+	}
+}
+
+// Called after a backwards jump. If the CPU is back at the same registers as after the previous
+// one, without having written memory or touched I/O in between, it will keep going round the
+// same loop until an interrupt, so whole iterations up to the next event can be skipped. Loops
+// polling $2002 aren't caught, as the read has side effects and sprite 0 hit isn't an event.
+void Nes::SkipIdleLoop(uint64_t target) {
+	auto registers = cpu->GetRegisters();
+	if (registers == idleLoop.registers && busAccesses == idleLoop.busAccesses && !(controllerLatch & 1)) {
+		// Keep clockNumber in phase, DMA alignment depends on the parity of the CPU cycle
+		uint64_t period = timestamp - idleLoop.timestamp;
+		if (period % 6)
+			period *= 2;
+		AdvanceTo(timestamp + (target - timestamp) / period * period);
+	}
+	idleLoop = { registers, timestamp, busAccesses };
+}
+
 void Nes::ClockCpuInstruction() {
 	do {
 		Clock();
@@ -225,45 +382,218 @@ void Nes::ClockCpuInstruction() {
 	} while (cpu->InstructionComplete());
 }
 
-void Nes::ClockFrame() {
+// Frames that are not drawn still run the PPU in full, but leave the screen buffer untouched
+void Nes::ClockFrame(bool draw) {
+	drawFrame = draw;
+	if (compareCpuCores)
+		RunFrameOnBothCores();
+	else if (draw && runAhead > 0)
+		RunAhead();
+	else
+		RunFrame();
+}
+
+// Runs the frame without drawing it, then draws the frame runAhead frames later with the same
+// input and puts the machine back. What is shown reacts to input that many frames sooner, while
+// the audio comes from the frame itself.
+void Nes::RunAhead() {
+	drawFrame = false;
+	RunFrame();
+	auto samples = apu->TakeSamples();
+	runAheadSamples.insert(runAheadSamples.end(), samples.begin(), samples.end());
+
+	if (!runAheadSnapshot)
+		runAheadSnapshot = std::make_unique<Snapshot>();
+	TakeSnapshot(*runAheadSnapshot);
+	// The audio of the frames run ahead is thrown away, so none is made
+	int sampleRate = audioSampleRate;
+	audioSampleRate = 0;
+	for (int i = 0; i < runAhead; i++) {
+		drawFrame = i == runAhead - 1;
+		RunFrame();
+	}
+	audioSampleRate = sampleRate;
+	RestoreSnapshot(*runAheadSnapshot);
+}
+
+uint32_t Nes::BeginEpoch() {
+	ramPages.SetEpoch(++epoch);
+	mapper->SetEpoch(epoch);
+	return epoch;
+}
+
+// A new mapper's pages all count as written, as nothing saved before has them
+void Nes::UseMapper(Mapper& mapper) {
+	this->mapper = &mapper;
+	mapper.SetEpoch(epoch);
+	mapper.GetChrPages().MarkAll();
+	mapper.GetSramPages().MarkAll();
+}
+
+// Audio samples not yet taken are left out, so they should be taken first
+void Nes::TakeSnapshot(Snapshot& snapshot) {
+	uint32_t since = snapshot.epoch;
+	snapshot.epoch = BeginEpoch();
+
+	snapshot.cpu = cpu->GetRegisters();
+	snapshot.ppu.emplace(*ppu);
+	snapshot.apu.emplace(*apu);
+	snapshot.apu->TakeSamples();
+	cart->TakeSnapshot(snapshot.cart, since);
+
+	ramPages.CopySince(since, snapshot.ram, ram);
+	std::memcpy(snapshot.oam, oam, sizeof(oam));
+	for (int i = 0; i < 2; i++)
+		snapshot.shiftRegisters[i] = controllers[i] ? controllers[i]->GetShiftRegister() : 0;
+	snapshot.controllerLatch = controllerLatch;
+	snapshot.clockNumber = clockNumber;
+	snapshot.timestamp = timestamp;
+	snapshot.ppuTimestamp = ppuTimestamp;
+	snapshot.apuTimestamp = apuTimestamp;
+	snapshot.idleLoop = idleLoop;
+	snapshot.oamAddr = oamAddr;
+	snapshot.dmaAddr = dmaAddr;
+	snapshot.dmaData = dmaData;
+	snapshot.dmaReady = dmaReady;
+	snapshot.dmaMode = dmaMode;
+}
+
+void Nes::RestoreSnapshot(const Snapshot& snapshot) {
+	cpu->SetRegisters(snapshot.cpu);
+	cart->RestoreSnapshot(snapshot.cart, snapshot.epoch);
+	ppu.emplace(*snapshot.ppu);
+	ppu->UpdatePages();
+	apu.emplace(*snapshot.apu);
+
+	ramPages.RestoreSince(snapshot.epoch, ram, snapshot.ram);
+	std::memcpy(oam, snapshot.oam, sizeof(oam));
+	spriteIndexValid = false;
+	for (int i = 0; i < 2; i++)
+		if (controllers[i])
+			controllers[i]->SetShiftRegister(snapshot.shiftRegisters[i]);
+	controllerLatch = snapshot.controllerLatch;
+	clockNumber = snapshot.clockNumber;
+	timestamp = snapshot.timestamp;
+	ppuTimestamp = snapshot.ppuTimestamp;
+	apuTimestamp = snapshot.apuTimestamp;
+	idleLoop = snapshot.idleLoop;
+	busAccesses++;
+	oamAddr = snapshot.oamAddr;
+	dmaAddr = snapshot.dmaAddr;
+	dmaData = snapshot.dmaData;
+	dmaReady = snapshot.dmaReady;
+	dmaMode = snapshot.dmaMode;
+}
+
+void Nes::RunFrame() {
+	// A held strobe picks up the new frame's input on the first dot
+	if (controllerLatch & 1) {
+		ClockEvent();
+		if (ppu->IsBeginningFrame()) {
+			SyncApu();
+			return;
+		}
+	}
+
 	do {
-		Clock();
+		RunUntil(NextEventTimestamp() - 1);
+		ClockEvent();
 	} while (!ppu->IsBeginningFrame());
+	// The APU otherwise lags until it is accessed, so its audio is caught up for the frame
+	SyncApu();
+}
+
+// Runs the frame on the reference interpreter, then again from the same state with predecoded
+// instructions, and checks both end in the same state. Audio samples not yet taken are dropped.
+void Nes::RunFrameOnBothCores() {
+	Savestate start = SaveState();
+	bool predecode = predecodeInstructions;
+	uint8_t shiftRegisters[2]{};
+	for (int i = 0; i < 2; i++)
+		if (controllers[i])
+			shiftRegisters[i] = controllers[i]->GetShiftRegister();
+
+	predecodeInstructions = false;
+	RunFrame();
+	auto reference = SaveState().GetBuffer();
+
+	predecodeInstructions = true;
+	if (!LoadState(start))
+		throw std::logic_error("Failed to restore state for CPU core comparison.");
+	for (int i = 0; i < 2; i++)
+		if (controllers[i])
+			controllers[i]->SetShiftRegister(shiftRegisters[i]);
+	RunFrame();
+	predecodeInstructions = predecode;
+
+	if (SaveState().GetBuffer() != reference)
+		throw std::logic_error("CPU cores diverged.");
 }
 
 void Nes::CpuWrite(uint16_t addr, uint8_t data) {
-	if (cart->CpuWrite(addr, data)) {
-	} else if (addr < 0x2000) {
-		addr &= 0x7FF;
-		ram[addr] = data;
-	} else if (addr >= 0x2000 && addr < 0x4000) {
+	busAccesses++;
+	if (addr < 0x2000) {
+		ram[addr & 0x7FF] = data;
+		ramPages.Mark(addr & 0x7FF);
+		return;
+	}
+	if (uint8_t* page = mapper->GetCpuWritePage(addr)) {
+		page[addr & 0xFF] = data;
+		mapper->GetSramPages().Mark(addr - 0x6000);
+		return;
+	}
+
+	// Mapper registers can switch the banks and mirroring the PPU is fetching from
+	bool mapperWrite = addr >= 0x4020;
+	if (mapperWrite)
+		SyncPpu();
+
+	// No mapper decodes below $4020, so I/O is handled without asking the cartridge
+	if (addr >= 0x2000 && addr < 0x4000) {
+		SyncPpu();
 		ppu->WriteFromCpu(addr, data);
 	} else if ((addr >= 0x4000 && addr < 0x4014) || addr == 0x4015 || addr == 0x4017) {
+		SyncApu();
 		apu->WriteFromCpu(addr, data);
 	} else if (addr == 0x4014) {
 		dmaAddr = data << 8;
 		dmaMode = true;
 	} else if (addr == 0x4016) {
 		controllerLatch = data & 1;
+	} else {
+		cart->CpuWrite(addr, data);
 	}
+
+	if (mapperWrite)
+		ppu->UpdatePages();
 }
 
 uint8_t Nes::CpuRead(uint16_t addr, bool readonly) {
+	if (addr < 0x2000)
+		return ram[addr & 0x7FF];
+	if (const uint8_t* page = mapper->GetCpuReadPage(addr))
+		return page[addr & 0xFF];
+
+	busAccesses++;
 	uint8_t data;
-	if (cart->CpuRead(addr, data, readonly)) {
-	} else if (addr < 0x2000) {
-		addr &= 0x7FF;
-		data = ram[addr];
-	} else if (addr >= 0x2000 && addr < 0x4000) {
+	if (addr >= 0x2000 && addr < 0x4000) {
+		SyncPpu();
 		data = ppu->ReadFromCpu(addr, readonly);
 	} else if (addr == 0x4015) {
+		SyncApu();
 		data = apu->ReadFromCpu(addr, readonly);
 	} else if (addr == 0x4016 || addr == 0x4017) {
 		data = controllers[addr & 1]->Read() + 0x40;
+	} else {
+		cart->CpuRead(addr, data, readonly);
 	}
 	return data;
 }
 
+bool Nes::GetPrgOffset(uint16_t addr, size_t& offset) const {
+	return mapper->GetPrgOffset(addr, offset);
+}
+
 void Nes::ClockDMA() {
 	if (!dmaReady) {
 		if (clockNumber % 2 == 1)
@@ -272,7 +602,8 @@ void Nes::ClockDMA() {
 		if (clockNumber % 2 == 0) {
 			dmaData = CpuRead(dmaAddr);
 		} else {
-			reinterpret_cast<uint8_t*>(oam)[dmaAddr & 0xFF] = dmaData;
+			SyncPpu();
+			WriteOAMByte(dmaAddr & 0xFF, dmaData);
 			dmaAddr++;
 			if ((dmaAddr & 0xFF) == 0) {
 				dmaMode = false;
@@ -282,29 +613,46 @@ void Nes::ClockDMA() {
 	}
 }
 
-bool Nes::GetCurrentSprites(int scanline, uint8_t spriteSize, ObjectAttributeMemory out[8], int& spriteCount, bool& sprite0Loaded, std::array<bool, 64>& currentSpriteNumbers) const {
+bool Nes::GetCurrentSprites(int scanline, uint8_t spriteSize, ObjectAttributeMemory out[8], int& spriteCount, bool& sprite0Loaded, std::array<bool, 64>& currentSpriteNumbers) {
 	spriteCount = 0;
 	sprite0Loaded = false;
 	std::memset(out, 0xFF, 32);
 	if (scanline >= Ppu::DRAWABLE_HEIGHT)
 		return false;
 
+	if (!spriteIndexValid || indexedSpriteSize != spriteSize)
+		IndexSprites(spriteSize);
+
+	const auto& sprites = spriteIndex[scanline];
+	for (int n = 0; n < sprites.count && n < 8; n++) {
+		uint8_t i = sprites.numbers[n];
+		if (i == 0)
+			sprite0Loaded = true;
+		out[spriteCount] = oam[i];
+		spriteCount++;
+
+		currentSpriteNumbers[i] = true;
+	}
+	return sprites.count > 8;
+}
+
+// A count of 9 marks a scanline with more than 8 sprites
+void Nes::IndexSprites(uint8_t spriteSize) {
+	for (auto& sprites : spriteIndex)
+		sprites.count = 0;
+
+	int height = 8 * (spriteSize + 1);
 	for (int i = 0; i < 64; i++) {
-		int difference = scanline - oam[i].y;
-		if (difference >= 0 && difference < 8 * (spriteSize + 1)) {
-			if (spriteCount < 8) {
-				if (i == 0)
-					sprite0Loaded = true;
-				out[spriteCount] = oam[i];
-				spriteCount++;
-
-				currentSpriteNumbers[i] = true;
-			} else {
-				return true;
-			}
+		for (int y = oam[i].y; y < oam[i].y + height && y < Ppu::DRAWABLE_HEIGHT; y++) {
+			auto& sprites = spriteIndex[y];
+			if (sprites.count < 8)
+				sprites.numbers[sprites.count] = i;
+			if (sprites.count <= 8)
+				sprites.count++;
 		}
 	}
-	return false;
+	indexedSpriteSize = spriteSize;
+	spriteIndexValid = true;
 }
 
 uint8_t Nes::ReadOAM() const {
@@ -316,10 +664,17 @@ void Nes::SetOAMAddr(uint8_t addr) {
 }
 
 void Nes::WriteOAM(uint8_t data) {
-	reinterpret_cast<uint8_t*>(oam)[oamAddr] = data;
+	WriteOAMByte(oamAddr, data);
 	oamAddr++;
 }
 
+void Nes::WriteOAMByte(uint8_t addr, uint8_t data) {
+	uint8_t& byte = reinterpret_cast<uint8_t*>(oam)[addr];
+	if (addr % 4 == 0 && byte != data)
+		spriteIndexValid = false;
+	byte = data;
+}
+
 void Nes::DrawPixel(int x, int y, uint8_t c) {
 	if (hideBorder && (x < 8 || y < 8 || x >= Ppu::DRAWABLE_WIDTH - 8 || y >= Ppu::DRAWABLE_HEIGHT - 8)) {
 		c = 0xF;
@@ -329,6 +684,11 @@ void Nes::DrawPixel(int x, int y, uint8_t c) {
 	screenBuffer[y * Ppu::DRAWABLE_WIDTH + x] = c;
 }
 
+void Nes::DrawScanline(int y, const uint8_t* colours) {
+	for (int x = 0; x < Ppu::DRAWABLE_WIDTH; x++)
+		DrawPixel(x, y, colours[x]);
+}
+
 std::vector<uint8_t> Nes::ToRgba(const std::vector<uint8_t>& indices) {
 	std::vector<uint8_t> rgba(4 * indices.size(), 0xFF);
 	for (size_t i = 0; i < indices.size(); i++) {
@@ -346,7 +706,12 @@ const std::vector<uint8_t>& Nes::GetScreenBuffer() const {
 
 std::vector<int16_t> Nes::TakeAudioSamples() {
 	if (apu) {
-		return apu->TakeSamples();
+		auto samples = apu->TakeSamples();
+		if (!runAheadSamples.empty()) {
+			samples.insert(samples.begin(), runAheadSamples.begin(), runAheadSamples.end());
+			runAheadSamples.clear();
+		}
+		return samples;
 	} else {
 		return {};
 	}
@@ -5,6 +5,8 @@
 #include "Cartridge.h"
 #include "Controller.h"
 #include "Savestate.h"
+#include "DirtyPages.h"
+#include <optional>
 
 class Nes {
 public:
@@ -15,22 +17,31 @@ public:
 	void UnplugController(int port);
 	uint8_t CpuRead(uint16_t addr, bool readonly = false);
 	void CpuWrite(uint16_t addr, uint8_t data);
-	bool GetCurrentSprites(int scanline, uint8_t spriteSize, ObjectAttributeMemory out[8], int& spriteCount, bool& sprite0Loaded, std::array<bool, 64>& currentSpriteNumbers) const;
+	bool GetPrgOffset(uint16_t addr, size_t& offset) const;
+	bool GetCurrentSprites(int scanline, uint8_t spriteSize, ObjectAttributeMemory out[8], int& spriteCount, bool& sprite0Loaded, std::array<bool, 64>& currentSpriteNumbers);
 	uint8_t ReadOAM() const;
 	void SetOAMAddr(uint8_t addr);
 	void WriteOAM(uint8_t data);
 	void DrawPixel(int x, int y, uint8_t c);
+	void DrawScanline(int y, const uint8_t* colours);
 	Savestate SaveState() const;
+	uint32_t SaveStateSince(Savestate& state);
 	bool LoadState(Savestate& state);
 	bool masterBg = true;
 	bool masterFg = true;
 	bool masterGreyscale = false;
 	bool hideBorder = false;
+	// Lower rates are made directly rather than downsampled, and 0 makes no audio at all
 	int audioSampleRate = 44100;
+	bool predecodeInstructions = true;
+	bool compareCpuCores = false;
+	bool skipIdleLoops = true;
+	int runAhead = 0;
 
 	void Clock();
 	void ClockCpuInstruction();
-	void ClockFrame();
+	void ClockFrame(bool draw = true);
+	bool IsDrawingFrame() const { return drawFrame; }
 
 	const std::vector<uint8_t>& GetScreenBuffer() const;
 	std::vector<int16_t> TakeAudioSamples();
@@ -42,11 +53,41 @@ public:
 private:
 	int emuStep = 0;
 	int clockNumber = 0;
-	std::shared_ptr<Cartridge> cart;
-	std::unique_ptr<Cpu> cpu;
-	std::unique_ptr<Ppu> ppu;
-	std::shared_ptr<Apu> apu;
+	bool drawFrame = true;
+
+	// Scheduling, in PPU dots
+	void RunFrame();
+	void RunFrameOnBothCores();
+	void RunUntil(uint64_t target);
+	void ClockEvent();
+	void ClockCpu();
+	void PollInterrupts();
+	void SyncPpu();
+	void SyncApu();
+	void AdvanceTo(uint64_t target);
+	uint64_t NextEventTimestamp() const;
+	uint64_t timestamp = 0;
+	uint64_t ppuTimestamp = 0;
+	uint64_t apuTimestamp = 0;
+
+	// Idle loop detection, see SkipIdleLoop
+	void SkipIdleLoop(uint64_t target);
+	struct IdleLoop
+	{
+		Cpu::Registers registers{};
+		uint64_t timestamp = 0;
+		uint64_t busAccesses = 0;
+	} idleLoop;
+	uint64_t busAccesses = 0;
+
+	// The components live inside Nes rather than on the heap, and are only engaged while a cartridge is inserted
+	std::optional<Cpu> cpu;
+	std::optional<Ppu> ppu;
+	std::optional<Apu> apu;
 	uint8_t ram[0x800];
+	DirtyPages ramPages;
+	std::shared_ptr<Cartridge> cart;
+	Mapper* mapper = nullptr;
 	std::unique_ptr<NesController> controllers[2];
 	uint8_t controllerLatch = 0;
 	std::vector<uint8_t> screenBuffer;
@@ -54,16 +95,71 @@ private:
 
 	// Sprites
 	void ClockDMA();
+	void WriteOAMByte(uint8_t addr, uint8_t data);
 	ObjectAttributeMemory oam[64];
+
+	// Sprites on each visible scanline in OAM order, rebuilt when a y coordinate or the sprite size changes
+	struct ScanlineSprites
+	{
+		uint8_t count;
+		uint8_t numbers[8];
+	};
+	void IndexSprites(uint8_t spriteSize);
+	std::array<ScanlineSprites, Ppu::DRAWABLE_HEIGHT> spriteIndex;
+	uint8_t indexedSpriteSize = 0;
+	bool spriteIndexValid = false;
 	uint8_t oamAddr = 0;
 	uint16_t dmaAddr = 0;
 	uint8_t dmaData = 0;
 	bool dmaReady = false;
 	bool dmaMode = false;
+
+	// Copy of the machine kept in memory. Once taken, a snapshot is retaken and restored
+	// in place, reusing what it holds, so neither allocates. Taking one starts an epoch, and
+	// RAM, CHR and SRAM are then only copied for the pages written since, see DirtyPages.
+	struct Snapshot
+	{
+		uint32_t epoch = 0;
+		Cpu::Registers cpu{};
+		std::optional<Ppu> ppu;
+		std::optional<Apu> apu;
+		Cartridge::Snapshot cart;
+		uint8_t ram[0x800];
+		ObjectAttributeMemory oam[64];
+		uint8_t shiftRegisters[2];
+		uint8_t controllerLatch;
+		int clockNumber;
+		uint64_t timestamp;
+		uint64_t ppuTimestamp;
+		uint64_t apuTimestamp;
+		IdleLoop idleLoop;
+		uint8_t oamAddr;
+		uint16_t dmaAddr;
+		uint8_t dmaData;
+		bool dmaReady;
+		bool dmaMode;
+	};
+	void TakeSnapshot(Snapshot& snapshot);
+	void RestoreSnapshot(const Snapshot& snapshot);
+
+	uint32_t BeginEpoch();
+	void UseMapper(Mapper& mapper);
+	uint32_t epoch = 0;
+
+	void SaveStateAfterCartridge(Savestate& state) const;
+	void LoadStateAfterCartridge(Savestate& state);
+
+	// Run-ahead, see RunAhead. The snapshot belongs to the inserted cartridge.
+	void RunAhead();
+	std::unique_ptr<Snapshot> runAheadSnapshot;
+	std::vector<int16_t> runAheadSamples;
+
+	mutable size_t lastStateSize = 0;
 };
 
 struct NesInterface : private Nes {
 	using Nes::SaveState;
+	using Nes::SaveStateSince;
 	using Nes::LoadState;
 
 	using Nes::Reset;
@@ -82,6 +178,7 @@ struct NesInterface : private Nes {
 	using Nes::masterFg;
 	using Nes::masterGreyscale;
 	using Nes::hideBorder;
+	using Nes::runAhead;
 
 	using Nes::ToRgba;
 };
@@ -0,0 +1,83 @@
+#include "Resampler.h"
+#include <algorithm>
+#include <cmath>
+
+// Taps are fixed point with this many fractional bits, which leaves room for a whole kernel of
+// full scale samples in 32 bits
+static constexpr int KERNEL_BITS = 14;
+// As are positions in the input
+static constexpr int POSITION_BITS = 32;
+
+Resampler::Resampler() :
+	step(uint64_t(1) << POSITION_BITS),
+	position(uint64_t(TAPS / 2 - 1) << POSITION_BITS),
+	history(TAPS, 0) {
+	BuildKernel();
+}
+
+void Resampler::SetRatio(double ratio) {
+	if (ratio == this->ratio)
+		return;
+	this->ratio = ratio;
+	step = static_cast<uint64_t>(std::llround(ratio * (uint64_t(1) << POSITION_BITS)));
+	BuildKernel();
+}
+
+// A Blackman windowed sinc for each phase, normalized so each passes a constant level unchanged
+void Resampler::BuildKernel() {
+	constexpr double PI = 3.14159265358979323846;
+	double cutoff = 0.9 * std::min(1.0, 1.0 / ratio);
+	for (int phase = 0; phase <= PHASES; phase++) {
+		double taps[TAPS];
+		double total = 0.0;
+		for (int i = 0; i < TAPS; i++) {
+			// Distance of input sample i from the output sample
+			double x = i + 1 - double(phase) / PHASES - TAPS / 2;
+			double sinc = x == 0.0 ? 1.0 : std::sin(PI * cutoff * x) / (PI * cutoff * x);
+			double w = (x + TAPS / 2) / TAPS;
+			double window = 0.42 - 0.5 * std::cos(2 * PI * w) + 0.08 * std::cos(4 * PI * w);
+			taps[i] = std::max(0.0, window) * sinc;
+			total += taps[i];
+		}
+		int32_t sum = 0;
+		for (int i = 0; i < TAPS; i++) {
+			kernel[phase][i] = static_cast<int16_t>(std::lround(taps[i] / total * (1 << KERNEL_BITS)));
+			sum += kernel[phase][i];
+		}
+		kernel[phase][TAPS / 2] += static_cast<int16_t>((1 << KERNEL_BITS) - sum);
+	}
+}
+
+void Resampler::Process(const std::vector<int16_t>& in, std::vector<int16_t>& out) {
+	history.insert(history.end(), in.begin(), in.end());
+
+	// Each output sample needs the input up to half the taps past it
+	uint64_t end = uint64_t(history.size() - TAPS / 2) << POSITION_BITS;
+	if (position >= end)
+		return;
+	size_t count = static_cast<size_t>((end - position + step - 1) / step);
+	size_t first = out.size();
+	out.resize(first + count);
+
+	for (size_t n = 0; n < count; n++) {
+		size_t centre = static_cast<size_t>(position >> POSITION_BITS);
+		uint32_t fraction = static_cast<uint32_t>(position);
+		int phase = static_cast<int>((uint64_t(fraction) * PHASES + (uint64_t(1) << (POSITION_BITS - 1))) >> POSITION_BITS);
+		const int16_t* samples = &history[centre + 1 - TAPS / 2];
+		const auto& taps = kernel[phase];
+
+		// Written so the compiler vectorizes it as multiply-adds of 16 bit pairs
+		int32_t acc = 0;
+		for (int i = 0; i < TAPS; i++)
+			acc += int32_t(samples[i]) * taps[i];
+		acc = (acc + (1 << (KERNEL_BITS - 1))) >> KERNEL_BITS;
+		out[first + n] = static_cast<int16_t>(std::clamp<int32_t>(acc, INT16_MIN, INT16_MAX));
+
+		position += step;
+	}
+
+	// Keep only the input the next output sample reaches back to, so the history doesn't grow
+	size_t drop = std::min(static_cast<size_t>(position >> POSITION_BITS) + 1 - TAPS / 2, history.size());
+	history.erase(history.begin(), history.begin() + drop);
+	position -= uint64_t(drop) << POSITION_BITS;
+}
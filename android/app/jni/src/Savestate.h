@@ -1,34 +1,91 @@
 #pragma once
 #include <vector>
 #include <cstdint>
-#include <deque>
+#include <span>
+#include <string>
 #include <limits>
 #include <cstring>
 #include "InvalidFileException.h"
+#include "DirtyPages.h"
 
 static_assert(std::numeric_limits<float>::is_iec559, "float must be IEC 559 (IEEE 754).");
 static_assert(sizeof(float) == 4, "float must be 4 bytes.");
 
+// Written into one contiguous buffer by each component in turn, and read back through a cursor.
+// A savestate constructed from a buffer reads it in place, so the buffer must outlive it.
 struct Savestate {
 
 	Savestate() {}
-	Savestate(const std::vector<uint8_t>& val) : buf(val.begin(), val.end()) {}
+	Savestate(std::span<const uint8_t> val) : view(val) {}
+	Savestate(const std::vector<uint8_t>& val) : view(val) {}
+	Savestate(std::vector<uint8_t>&&) = delete;
 
+	// Writes over a savestate saved earlier, in epoch since, in place. Memory pushed with PushPages
+	// is only rewritten on the pages written since. The stretches of bytes that changed, and what
+	// they were, are kept so the two states can be compared, or the old one put back.
+	Savestate(std::vector<uint8_t>& previous, uint32_t since) : target(&previous), since(since) {}
+
+	struct Rewrite
+	{
+		size_t offset;
+		size_t length;
+	};
+
+	// Whether what was pushed had the layout of the savestate written over
+	bool MatchedLayout() const {
+		return target && !mismatched && pos == target->size();
+	}
+
+	// In order, with the bytes they replaced one after another in GetReplaced
+	const std::vector<Rewrite>& GetRewrites() const {
+		return rewrites;
+	}
+
+	const std::vector<uint8_t>& GetReplaced() const {
+		return replaced;
+	}
+
+	// Puts back the savestate written over
+	void Undo() {
+		const uint8_t* old = replaced.data();
+		for (const auto& rewrite : rewrites) {
+			std::memcpy(target->data() + rewrite.offset, old, rewrite.length);
+			old += rewrite.length;
+		}
+		rewrites.clear();
+		replaced.clear();
+	}
+
+	// Bytes not yet read
 	size_t size() const {
-		return buf.size();
+		return Input().size() - pos;
+	}
+
+	const std::vector<uint8_t>& GetBuffer() const {
+		return buf;
+	}
+
+	void Reserve(size_t len) {
+		buf.reserve(len);
+	}
+
+	// Counts the bytes save pushes, without storing them
+	template <class F>
+	static size_t Measure(F save) {
+		Savestate state;
+		state.measuring = true;
+		save(state);
+		return state.measured;
 	}
 
-	std::vector<uint8_t> GetBuffer() const {
-		return std::vector<uint8_t>(buf.begin(), buf.end());
+	// A savestate reading the rest of this one, which is left where it is
+	Savestate Peek() const {
+		return Savestate(Input().subspan(pos));
 	}
 
 	template <class T>
 	void Push(std::common_type_t<T> val) {
-		buf.insert(
-			buf.end(),
-			(const uint8_t*)&val,
-			(const uint8_t*)&val + sizeof(T)
-		);
+		PushArray(&val, sizeof(T));
 	}
 
 	void PushSize(size_t val) {
@@ -47,6 +104,15 @@ struct Savestate {
 	}
 
 	void PushArray(const void* p, size_t len) {
+		if (measuring) {
+			measured += len;
+			return;
+		}
+		if (target) {
+			RewriteAt(pos, p, len);
+			pos += len;
+			return;
+		}
 		buf.insert(
 			buf.end(),
 			(const uint8_t*)p,
@@ -59,26 +125,26 @@ struct Savestate {
 		PushArray(val.data(), val.size());
 	}
 
-	void PushState(const Savestate& val) {
-		buf.insert(
-			buf.end(),
-			val.buf.begin(),
-			val.buf.end()
-		);
+	// Memory whose written pages are tracked, see DirtyPages
+	void PushPages(const uint8_t* p, size_t len, const DirtyPages& pages) {
+		if (!target) {
+			PushArray(p, len);
+			return;
+		}
+		if (pos + len > target->size()) {
+			mismatched = true;
+		} else {
+			pages.ForEachSince(since, [&](size_t offset, size_t length) {
+				RewriteAt(pos + offset, p + offset, length);
+			});
+		}
+		pos += len;
 	}
 
 	template <class T>
 	T Pop() {
-		if (buf.size() < sizeof(T))
-			throw InvalidFileException("Invalid savestate.");
-
 		T out{};
-		std::copy(
-			buf.begin(),
-			buf.begin() + sizeof(T),
-			(uint8_t*)&out
-		);
-		buf.erase(buf.begin(), buf.begin() + sizeof(T));
+		PopArray(&out, sizeof(T));
 		return out;
 	}
 
@@ -98,15 +164,25 @@ struct Savestate {
 	}
 
 	void PopArray(void* p, size_t len) {
-		if (buf.size() < len)
+		auto in = PopSpan(len);
+		std::memcpy(p, in.data(), len);
+	}
+
+	// Read in place, so only valid as long as the buffer being read
+	std::span<const uint8_t> PopSpan(size_t len) {
+		auto in = Input();
+		if (in.size() - pos < len)
 			throw InvalidFileException("Invalid savestate.");
 
-		std::copy(
-			buf.begin(),
-			buf.begin() + len,
-			(uint8_t*)p
-		);
-		buf.erase(buf.begin(), buf.begin() + len);
+		auto out = in.subspan(pos, len);
+		pos += len;
+		return out;
+	}
+
+	void Skip(size_t len) {
+		if (size() < len)
+			throw InvalidFileException("Invalid savestate.");
+		pos += len;
 	}
 
 	std::vector<uint8_t> PopVec() {
@@ -126,5 +202,34 @@ private:
 		return out;
 	}
 
-	std::deque<uint8_t> buf;
+	std::span<const uint8_t> Input() const {
+		return view.data() ? view : std::span<const uint8_t>(buf);
+	}
+
+	void RewriteAt(size_t offset, const void* p, size_t len) {
+		if (mismatched || offset + len > target->size()) {
+			mismatched = true;
+			return;
+		}
+		uint8_t* old = target->data() + offset;
+		if (std::memcmp(old, p, len) == 0)
+			return;
+		if (!rewrites.empty() && rewrites.back().offset + rewrites.back().length == offset)
+			rewrites.back().length += len;
+		else
+			rewrites.push_back({ offset, len });
+		replaced.insert(replaced.end(), old, old + len);
+		std::memcpy(old, p, len);
+	}
+
+	std::vector<uint8_t> buf;
+	std::span<const uint8_t> view;
+	size_t pos = 0;
+	bool measuring = false;
+	size_t measured = 0;
+	std::vector<uint8_t>* target = nullptr;
+	uint32_t since = 0;
+	bool mismatched = false;
+	std::vector<Rewrite> rewrites;
+	std::vector<uint8_t> replaced;
 };
@@ -1,4 +1,5 @@
 #include "Application.h"
+#include <algorithm>
 
 bool Key::operator==(const Key& rhs) const {
 	if (type != rhs.type)
@@ -130,9 +131,12 @@ void Application::Run() {
 				fps = 0;
 			}
 
-			while (t > 1.0f / targetFps) {
+			float frameTime = 1.0f / (targetFps * audioRate);
+			while (t > frameTime) {
 				fps++;
 				SDL_RenderClear(ren);
+				// Frames are only paced by the audio while an update queues some, see EnqueueAudio
+				audioRate = 1.0f;
 				if (!OnUpdate())
 					goto cleanup;
 				SDL_RenderPresent(ren);
@@ -140,8 +144,8 @@ void Application::Run() {
 
 				if (targetFps) {
 					do {
-						t -= 1.0f / targetFps;
-					} while (t > 3.0f / targetFps);
+						t -= frameTime;
+					} while (t > 3.0f * frameTime);
 				}
 			}
 
@@ -483,14 +487,15 @@ void Application::DrawBackground(float r, float g, float b) const {
 }
 
 void Application::EnqueueAudio(const std::vector<int16_t>& samples) {
-	std::unique_lock<std::mutex> lock(audioMtx);
+	if (samples.empty())
+		return;
 
 	if (!audioDevice) {
 		// Initialize audio for the first time
 		SDL_AudioSpec spec{};
 		spec.size = 512 * sizeof(int16_t);
 		spec.freq = AUDIO_SAMPLE_RATE;
-		spec.format = AUDIO_S16LSB;
+		spec.format = AUDIO_S16SYS;
 		spec.silence = 0;
 		spec.channels = 1;
 		spec.padding = 0;
@@ -513,39 +518,26 @@ void Application::EnqueueAudio(const std::vector<int16_t>& samples) {
 		SDL_PauseAudioDevice(audioDevice.value(), 0);
 	}
 
-	audioBuffer.insert(
-		audioBuffer.end(),
-		samples.begin(),
-		samples.end()
-	);
+	// Samples that don't fit are dropped, which the pacing below keeps from happening
+	audioRing.Write(samples.data(), samples.size());
+
+	// Run up to AUDIO_RATE_ADJUST faster when the ring is emptier than the target, and slower
+	// when it is fuller
+	float target = AUDIO_LATENCY * AUDIO_SAMPLE_RATE;
+	float error = std::clamp((target - audioRing.GetSize()) / target, -1.0f, 1.0f);
+	audioRate = 1.0f + AUDIO_RATE_ADJUST * error;
 }
 
+// Called on the audio thread. If the ring runs dry, the last sample is held.
 void Application::AudioCallback(void* userdata, uint8_t* stream, int len) {
 	Application* self = (Application*)userdata;
-	std::unique_lock<std::mutex> lock(self->audioMtx);
-
-	auto& buffer = self->audioBuffer;
-	size_t consumeLen = std::min((size_t)len / 2, buffer.size());
-
-	if (buffer.size()) {
-		for (int i = 0; i < len; i += 2) {
-			float m = (float)i / len;
-			int16_t sample = buffer[(size_t)(m * consumeLen)];
-			stream[i + 0] = sample & 0xFF;
-			stream[i + 1] = sample >> 8;
-		}
-		self->lastAudioSample = buffer.back();
-	} else {
-		for (int i = 0; i < len; i += 2) {
-			stream[i + 0] = self->lastAudioSample & 0xFF;
-			stream[i + 1] = self->lastAudioSample >> 8;
-		}
-	}
+	int16_t* out = (int16_t*)stream;
+	size_t count = (size_t)len / sizeof(int16_t);
 
-	buffer.erase(
-		buffer.begin(),
-		buffer.begin() + consumeLen
-	);
+	size_t read = self->audioRing.Read(out, count);
+	if (read)
+		self->lastAudioSample = out[read - 1];
+	std::fill(out + read, out + count, self->lastAudioSample);
 }
 
 void Application::SetHapticsEnabled(bool enabled) {
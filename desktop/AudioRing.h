@@ -0,0 +1,53 @@
+#pragma once
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <memory>
+
+// A fixed size queue of samples between one thread writing and one reading, such as the emulation
+// and the audio device. Each side only moves its own position, so neither waits on the other.
+class AudioRing
+{
+public:
+	// Holds up to capacity samples, rounded up to a power of 2
+	explicit AudioRing(size_t capacity) {
+		while (mask + 1 < capacity)
+			mask = mask * 2 + 1;
+		samples = std::make_unique<int16_t[]>(mask + 1);
+	}
+
+	size_t GetCapacity() const { return mask + 1; }
+
+	// Samples written and not yet read, which either side can ask for
+	size_t GetSize() const {
+		return writePos.load(std::memory_order_acquire) - readPos.load(std::memory_order_acquire);
+	}
+
+	// Writes as many of the samples as there is room for, and returns how many
+	size_t Write(const int16_t* data, size_t count) {
+		size_t write = writePos.load(std::memory_order_relaxed);
+		size_t read = readPos.load(std::memory_order_acquire);
+		count = std::min(count, GetCapacity() - (write - read));
+		for (size_t i = 0; i < count; i++)
+			samples[(write + i) & mask] = data[i];
+		writePos.store(write + count, std::memory_order_release);
+		return count;
+	}
+
+	// Reads up to count samples, and returns how many there were
+	size_t Read(int16_t* data, size_t count) {
+		size_t read = readPos.load(std::memory_order_relaxed);
+		size_t write = writePos.load(std::memory_order_acquire);
+		count = std::min(count, write - read);
+		for (size_t i = 0; i < count; i++)
+			data[i] = samples[(read + i) & mask];
+		readPos.store(read + count, std::memory_order_release);
+		return count;
+	}
+private:
+	std::unique_ptr<int16_t[]> samples;
+	size_t mask = 0;
+	// Count up without wrapping, so the size is always their difference
+	std::atomic<size_t> writePos = 0;
+	std::atomic<size_t> readPos = 0;
+};
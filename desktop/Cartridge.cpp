@@ -23,10 +23,11 @@ Cartridge::Cartridge(std::string cartName, std::vector<uint8_t> bytes, std::vect
 	bytes.erase(bytes.begin(), bytes.begin() + sizeof(header));
 
 	// Extract prg
+	auto image = std::make_shared<Rom>();
 	if (bytes.size() < static_cast<size_t>(header.prgChunks * 0x4000))
 		throw InvalidFileException("Invalid ROM (PRG too small).");
-	prg.resize(header.prgChunks * 16384);
-	std::memcpy(prg.data(), bytes.data(), header.prgChunks * 0x4000);
+	image->prg.resize(header.prgChunks * 16384);
+	std::memcpy(image->prg.data(), bytes.data(), header.prgChunks * 0x4000);
 	bytes.erase(bytes.begin(), bytes.begin() + header.prgChunks * 0x4000);
 
 	// Extract chr
@@ -36,10 +37,13 @@ Cartridge::Cartridge(std::string cartName, std::vector<uint8_t> bytes, std::vect
 	} else {
 		if (bytes.size() < static_cast<size_t>(header.chrChunks * 0x2000))
 			throw InvalidFileException("Invalid ROM (CHR too small).");
-		chr.resize(header.chrChunks * 8192);
-		std::memcpy(chr.data(), bytes.data(), header.chrChunks * 0x2000);
+		image->chr.resize(header.chrChunks * 8192);
+		std::memcpy(image->chr.data(), bytes.data(), header.chrChunks * 0x2000);
 		bytes.erase(bytes.begin(), bytes.begin() + header.chrChunks * 0x2000);
+		chr = image->chr;
 	}
+	image->hash = HashRom(*image);
+	rom = std::move(image);
 
 	// Select mapper
 	if (!header.padding[3] && !header.padding[4] && !header.padding[5] && !header.padding[6])
@@ -51,42 +55,131 @@ Cartridge::Cartridge(std::string cartName, std::vector<uint8_t> bytes, std::vect
 	mapper->SetSram(std::move(sram));
 }
 
-Cartridge::Cartridge(Savestate& state) {
+Cartridge::Cartridge(Savestate& state, const Cartridge* loaded) {
 
 	cartName = state.PopString();
 	header = state.Pop<Header>();
-	prg = state.PopVec();
+
+	// Older savestates store the ROM, as it was when saved, in place of its hash
+	size_t prgSize = state.PopSize();
+	if (!prgSize)
+		throw InvalidFileException("Invalid savestate (no ROM).");
+	std::vector<uint8_t> prg(prgSize);
+	state.PopArray(prg.data(), prgSize);
 	chr = state.PopVec();
+	if (loaded && loaded->rom->prg == prg) {
+		rom = loaded->rom;
+	} else {
+		auto image = std::make_shared<Rom>();
+		image->prg = std::move(prg);
+		image->chr = chr;
+		image->hash = HashRom(*image);
+		rom = std::move(image);
+	}
 
-	int mapperNumber = state.Pop<int32_t>();
-	LoadMapper(mapperNumber, &state);
+	LoadMapper(state.Pop<int32_t>());
+	mapper->LoadState(state);
 	mapper->SetSram(state.PopVec());
 }
 
-Savestate Cartridge::SaveState() const {
-	Savestate state;
+// Skips the cartridge part of a savestate, having checked it can be loaded onto this cartridge
+// in place. Returns false for older savestates, which store their own ROM instead.
+bool Cartridge::ValidateState(Savestate& state) const {
+	state.Skip(state.PopSize());
+	Header stateHeader = state.Pop<Header>();
+	if (state.PopSize())
+		return false;
+	if (std::memcmp(&stateHeader, &header, sizeof(header)) || state.Pop<uint64_t>() != rom->hash)
+		throw InvalidFileException("Savestate is for a different ROM.");
+
+	if (state.Pop<uint8_t>()) {
+		if (state.PopSize() != chr.size())
+			throw InvalidFileException("Invalid savestate.");
+		state.Skip(chr.size());
+	}
+
+	if (state.Pop<int32_t>() != mapper->MapperNumber())
+		throw InvalidFileException("Invalid savestate (wrong mapper).");
+	state.Skip(Savestate::Measure([&](Savestate& s) { mapper->SaveState(s); }));
+	if (state.PopSize() != mapper->GetSram().size())
+		throw InvalidFileException("Invalid savestate (wrong SRAM size).");
+	state.Skip(mapper->GetSram().size());
+	return true;
+}
+
+// Into the existing memory, once the savestate has been checked by ValidateState
+void Cartridge::LoadState(Savestate& state) {
+	state.Skip(state.PopSize());
+	state.Pop<Header>();
+	state.PopSize();
+	state.Pop<uint64_t>();
+
+	// Only written if different, so decoded CHR rows are kept unless CHR changed
+	std::span<const uint8_t> loaded = rom->chr;
+	if (state.Pop<uint8_t>()) {
+		state.PopSize();
+		loaded = state.PopSpan(chr.size());
+	}
+	if (!std::equal(loaded.begin(), loaded.end(), chr.begin())) {
+		std::copy(loaded.begin(), loaded.end(), chr.begin());
+		mapper->InvalidateChrRows();
+		mapper->GetChrPages().MarkAll();
+	}
+
+	state.Pop<int32_t>();
+	mapper->LoadState(state);
+	mapper->LoadSram(state);
+}
+
+// CHR is only stored if the game wrote to it, which for CHR RAM is always assumed
+void Cartridge::SaveState(Savestate& state) const {
 	state.PushString(cartName);
 	state.Push<Header>(header);
-	state.PushVec(prg);
-	state.PushVec(chr);
+	state.PushSize(0);
+	state.Push<uint64_t>(rom->hash);
+
+	bool changed = chr != rom->chr;
+	state.Push<uint8_t>(changed);
+	if (changed) {
+		state.PushSize(chr.size());
+		state.PushPages(chr.data(), chr.size(), mapper->GetChrPages());
+	}
 
 	state.Push<int32_t>(mapper->MapperNumber());
-	state.PushState(mapper->SaveState());
-	state.PushVec(mapper->GetSram());
-	return state;
+	mapper->SaveState(state);
+	auto& sram = mapper->GetSram();
+	state.PushSize(sram.size());
+	state.PushPages(sram.data(), sram.size(), mapper->GetSramPages());
+}
+
+void Cartridge::TakeSnapshot(Snapshot& snapshot, uint32_t since) const {
+	if (snapshot.mapper)
+		snapshot.mapper->CopyState(*mapper);
+	else
+		snapshot.mapper = mapper->Clone();
+	auto& sram = mapper->GetSram();
+	snapshot.chr.resize(chr.size());
+	snapshot.sram.resize(sram.size());
+	mapper->GetChrPages().CopySince(since, snapshot.chr.data(), chr.data());
+	mapper->GetSramPages().CopySince(since, snapshot.sram.data(), sram.data());
+}
+
+// Decoded CHR rows are only dropped if the game changed CHR since
+void Cartridge::RestoreSnapshot(const Snapshot& snapshot, uint32_t since) {
+	mapper->CopyState(*snapshot.mapper);
+	if (mapper->GetChrPages().RestoreSince(since, chr.data(), snapshot.chr.data()))
+		mapper->InvalidateChrRows();
+	mapper->GetSramPages().RestoreSince(since, mapper->GetSram().data(), snapshot.sram.data());
 }
 
 void Cartridge::Reset() {
 	mapper->Reset();
 }
 
-void Cartridge::LoadMapper(int mapperNumber, Savestate* state) {
+void Cartridge::LoadMapper(int mapperNumber) {
 
 	auto createMapper = [&]<class M>() {
-		if (state)
-			return std::make_unique<M>(*state, prg, chr);
-		else
-			return std::make_unique<M>(mapperNumber, header.prgChunks, header.chrChunks, prg, chr);
+		return std::make_unique<M>(mapperNumber, header.prgChunks, header.chrChunks, rom->prg, chr);
 	};
 
 	switch (mapperNumber) {
@@ -111,14 +204,6 @@ bool Cartridge::CpuRead(uint16_t& addr, uint8_t& data, bool readonly) {
 	return mapper->MapCpuRead(addr, data, readonly);
 }
 
-bool Cartridge::PpuWrite(uint16_t& addr, uint8_t data) {
-	return mapper->MapPpuWrite(addr, data);
-}
-
-bool Cartridge::PpuRead(uint16_t& addr, uint8_t& data, bool readonly) {
-	return mapper->MapPpuRead(addr, data, readonly);
-}
-
 MirrorMode Cartridge::GetMirrorMode() const {
 	auto mode = mapper->GetMirrorMode();
 	if (mode == MirrorMode::Hardwired)
@@ -142,3 +227,12 @@ const std::vector<uint8_t>& Cartridge::GetSram() const {
 const std::string& Cartridge::GetCartridgeName() const {
 	return cartName;
 }
+
+// 64 bit FNV-1a
+uint64_t Cartridge::HashRom(const Rom& rom) {
+	uint64_t hash = 0xCBF29CE484222325;
+	for (auto* data : { &rom.prg, &rom.chr })
+		for (uint8_t b : *data)
+			hash = (hash ^ b) * 0x100000001B3;
+	return hash;
+}
@@ -10,20 +10,33 @@ class Cartridge
 {
 public:
 	Cartridge(std::string cartName, std::vector<uint8_t> rom, std::vector<uint8_t> sram);
-	Cartridge(Savestate& state);
+	// From an older savestate storing its ROM. Savestates now reference the ROM of the loaded
+	// cartridge by hash, and are loaded onto it in place.
+	Cartridge(Savestate& state, const Cartridge* loaded);
 	void Reset();
 	bool CpuWrite(uint16_t& addr, uint8_t data);
 	bool CpuRead(uint16_t& addr, uint8_t& data, bool readonly);
-	bool PpuWrite(uint16_t& addr, uint8_t data);
-	bool PpuRead(uint16_t& addr, uint8_t& data, bool readonly);
 	MirrorMode GetMirrorMode() const;
 	Mapper& GetMapper();
 	const Mapper& GetMapper() const;
-	Savestate SaveState() const;
+	void SaveState(Savestate& state) const;
+	bool ValidateState(Savestate& state) const;
+	void LoadState(Savestate& state);
+
+	// Everything a running game can change, see Nes::Snapshot. CHR and SRAM are copied by page,
+	// only those written since the epoch the snapshot was last taken in.
+	struct Snapshot
+	{
+		std::unique_ptr<Mapper> mapper;
+		std::vector<uint8_t> chr;
+		std::vector<uint8_t> sram;
+	};
+	void TakeSnapshot(Snapshot& snapshot, uint32_t since) const;
+	void RestoreSnapshot(const Snapshot& snapshot, uint32_t since);
 	const std::vector<uint8_t>& GetSram() const;
 	const std::string& GetCartridgeName() const;
 private:
-	void LoadMapper(int mapperNumber, Savestate* state = nullptr);
+	void LoadMapper(int mapperNumber);
 	std::string cartName;
 	std::unique_ptr<Mapper> mapper;
 	struct Header
@@ -49,6 +62,16 @@ private:
 		uint8_t prgRamSize;
 		uint8_t padding[7];
 	} header;
-	std::vector<uint8_t> prg;
 	std::vector<uint8_t> chr;
+
+	// PRG and CHR as loaded from file, shared with cartridges loaded from savestates of this one.
+	// PRG is mapped from here, as nothing writes it. CHR is empty for CHR RAM.
+	struct Rom
+	{
+		std::vector<uint8_t> prg;
+		std::vector<uint8_t> chr;
+		uint64_t hash;
+	};
+	std::shared_ptr<const Rom> rom;
+	static uint64_t HashRom(const Rom& rom);
 };
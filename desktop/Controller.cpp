@@ -31,6 +31,14 @@ uint8_t NesController::Read() {
 	return res;
 }
 
+uint8_t NesController::GetShiftRegister() const {
+	return state;
+}
+
+void NesController::SetShiftRegister(uint8_t value) {
+	state = value;
+}
+
 LocalNesInput::LocalNesInput(const InputSource<Key>& input) :
 	input(input) {
 }
@@ -1,61 +1,74 @@
 #include "Cpu.h"
 #include "Nes.h"
+#include <algorithm>
 #include <vector>
 
-#define X(op, addrmode, cycles) Cpu::Instruction(#op, &Cpu::op, #addrmode, &Cpu::addrmode, cycles)
-Cpu::Instruction Cpu::instructions[256]
-{
-	/* YX*/ /* 0 */         /* 1 */         /* 2 */         /* 3 */         /* 4 */         /* 5 */         /* 6 */         /* 7 */         /* 8 */         /* 9 */         /* A */         /* B */         /* C */         /* D */         /* E */         /* F */
-	/* 0 */ X(BRK, IMM, 7), X(ORA, IDX, 6), X(KIL, IMP, 2), X(SLO, IDX, 8), X(DOP, ZRP, 3), X(ORA, ZRP, 3), X(ASL, ZRP, 5), X(SLO, ZRP, 5), X(PHP, IMP, 3), X(ORA, IMM, 2), X(ASL, ACC, 2), X(AAC, IMM, 2), X(TOP, ABS, 4), X(ORA, ABS, 4), X(ASL, ABS, 6), X(SLO, ABS, 6),
-	/* 1 */ X(BPL, REL, 2), X(ORA, IDY, 5), X(KIL, IMP, 2), X(SLO, IDY, 8), X(DOP, ZPX, 4), X(ORA, ZPX, 4), X(ASL, ZPX, 6), X(SLO, ZPX, 6), X(CLC, IMP, 2), X(ORA, ABY, 4), X(NOP, IMP, 2), X(SLO, ABY, 7), X(TOP, ABX, 4), X(ORA, ABX, 4), X(ASL, ABX, 7), X(SLO, ABX, 7),
-	/* 2 */ X(JSR, ABS, 6), X(AND, IDX, 6), X(KIL, IMP, 2), X(RLA, IDX, 8), X(BIT, ZRP, 3), X(AND, ZRP, 3), X(ROL, ZRP, 5), X(RLA, ZRP, 5), X(PLP, IMP, 4), X(AND, IMM, 2), X(ROL, ACC, 2), X(AAC, IMM, 2), X(BIT, ABS, 4), X(AND, ABS, 4), X(ROL, ABS, 6), X(RLA, ABS, 6),
-	/* 3 */ X(BMI, REL, 2), X(AND, IDY, 5), X(KIL, IMP, 2), X(RLA, IDY, 8), X(DOP, ZPX, 4), X(AND, ZPX, 4), X(ROL, ZPX, 6), X(RLA, ZPX, 6), X(SEC, IMP, 2), X(AND, ABY, 4), X(NOP, IMP, 2), X(RLA, ABY, 7), X(TOP, ABX, 4), X(AND, ABX, 4), X(ROL, ABX, 7), X(RLA, ABX, 7),
-
-	/* 4 */ X(RTI, IMP, 6), X(EOR, IDX, 6), X(KIL, IMP, 2), X(SRE, IDX, 8), X(DOP, ZRP, 3), X(EOR, ZRP, 3), X(LSR, ZRP, 5), X(SRE, ZRP, 5), X(PHA, IMP, 3), X(EOR, IMM, 2), X(LSR, ACC, 2), X(ASR, IMM, 2), X(JMP, ABS, 3), X(EOR, ABS, 4), X(LSR, ABS, 6), X(SRE, ABS, 6),
-	/* 5 */ X(BVC, REL, 2), X(EOR, IDY, 5), X(KIL, IMP, 2), X(SRE, IDY, 8), X(DOP, ZPX, 4), X(EOR, ZPX, 4), X(LSR, ZPX, 6), X(SRE, ZPX, 6), X(CLI, IMP, 2), X(EOR, ABY, 4), X(NOP, IMP, 2), X(SRE, ABY, 7), X(TOP, ABX, 4), X(EOR, ABX, 4), X(LSR, ABX, 7), X(SRE, ABX, 7),
-	/* 6 */ X(RTS, IMP, 6), X(ADC, IDX, 6), X(KIL, IMP, 2), X(RRA, IDX, 8), X(DOP, ZRP, 3), X(ADC, ZRP, 3), X(ROR, ZRP, 5), X(RRA, ZRP, 5), X(PLA, IMP, 4), X(ADC, IMM, 2), X(ROR, ACC, 2), X(ARR, IMM, 2), X(JMP, IND, 5), X(ADC, ABS, 4), X(ROR, ABS, 6), X(RRA, ABS, 6),
-	/* 7 */ X(BVS, REL, 2), X(ADC, IDY, 5), X(KIL, IMP, 2), X(RRA, IDY, 8), X(DOP, ZPX, 4), X(ADC, ZPX, 4), X(ROR, ZPX, 6), X(RRA, ZPX, 6), X(SEI, IMP, 2), X(ADC, ABY, 4), X(NOP, IMP, 2), X(RRA, ABY, 7), X(TOP, ABX, 4), X(ADC, ABX, 4), X(ROR, ABX, 7), X(RRA, ABX, 7),
-
-	/* 8 */ X(DOP, IMM, 2), X(STA, IDX, 6), X(DOP, IMM, 2), X(SAX, IDX, 6), X(STY, ZRP, 3), X(STA, ZRP, 3), X(STX, ZRP, 3), X(SAX, ZRP, 3), X(DEY, IMP, 2), X(DOP, IMM, 2), X(TXA, IMP, 2), X(XAA, IMM, 2), X(STY, ABS, 4), X(STA, ABS, 4), X(STX, ABS, 4), X(SAX, ABS, 4),
-	/* 9 */ X(BCC, REL, 2), X(STA, IDY, 6), X(KIL, IMP, 2), X(AXA, IDY, 6), X(STY, ZPX, 4), X(STA, ZPX, 4), X(STX, ZPY, 4), X(SAX, ZPY, 4), X(TYA, IMP, 2), X(STA, ABY, 5), X(TXS, IMP, 2), X(XAS, ABY, 5), X(SYA, ABX, 5), X(STA, ABX, 5), X(SXA, ABY, 5), X(AXA, ABY, 5),
-	/* A */ X(LDY, IMM, 2), X(LDA, IDX, 6), X(LDX, IMM, 2), X(LAX, IDX, 6), X(LDY, ZRP, 3), X(LDA, ZRP, 3), X(LDX, ZRP, 3), X(LAX, ZRP, 3), X(TAY, IMP, 2), X(LDA, IMM, 2), X(TAX, IMP, 2), X(ATX, IMM, 2), X(LDY, ABS, 4), X(LDA, ABS, 4), X(LDX, ABS, 4), X(LAX, ABS, 4),
-	/* B */ X(BCS, REL, 2), X(LDA, IDY, 5), X(KIL, IMP, 2), X(LAX, IDY, 5), X(LDY, ZPX, 4), X(LDA, ZPX, 4), X(LDX, ZPY, 4), X(LAX, ZPY, 4), X(CLV, IMP, 2), X(LDA, ABY, 4), X(TSX, IMP, 2), X(LAR, ABY, 4), X(LDY, ABX, 4), X(LDA, ABX, 4), X(LDX, ABY, 4), X(LAX, ABY, 4),
-
-	/* C */ X(CPY, IMM, 2), X(CMP, IDX, 6), X(DOP, IMM, 2), X(DCP, IDX, 8), X(CPY, ZRP, 3), X(CMP, ZRP, 3), X(DEC, ZRP, 5), X(DCP, ZRP, 5), X(INY, IMP, 2), X(CMP, IMM, 2), X(DEX, IMP, 2), X(AXS, IMM, 2), X(CPY, ABS, 4), X(CMP, ABS, 4), X(DEC, ABS, 6), X(DCP, ABS, 6),
-	/* D */ X(BNE, REL, 2), X(CMP, IDY, 5), X(KIL, IMP, 2), X(DCP, IDY, 8), X(DOP, ZPX, 4), X(CMP, ZPX, 4), X(DEC, ZPX, 6), X(DCP, ZPX, 6), X(CLD, IMP, 2), X(CMP, ABY, 4), X(NOP, IMP, 2), X(DCP, ABY, 7), X(TOP, ABX, 4), X(CMP, ABX, 4), X(DEC, ABX, 7), X(DCP, ABX, 7),
-	/* E */ X(CPX, IMM, 2), X(SBC, IDX, 6), X(DOP, IMM, 2), X(ISB, IDX, 8), X(CPX, ZRP, 3), X(SBC, ZRP, 3), X(INC, ZRP, 5), X(ISB, ZRP, 5), X(INX, IMP, 2), X(SBC, IMM, 2), X(NOP, IMP, 2), X(SBC, IMM, 2), X(CPX, ABS, 4), X(SBC, ABS, 4), X(INC, ABS, 6), X(ISB, ABS, 6),
+// 16x16 opcode matrix, expanded once for the metadata table and once for the dispatch table
+#define CPU_INSTRUCTIONS \
+	/* YX*/ /* 0 */         /* 1 */         /* 2 */         /* 3 */         /* 4 */         /* 5 */         /* 6 */         /* 7 */         /* 8 */         /* 9 */         /* A */         /* B */         /* C */         /* D */         /* E */         /* F */ \
+	/* 0 */ X(BRK, IMM, 7), X(ORA, IDX, 6), X(KIL, IMP, 2), X(SLO, IDX, 8), X(DOP, ZRP, 3), X(ORA, ZRP, 3), X(ASL, ZRP, 5), X(SLO, ZRP, 5), X(PHP, IMP, 3), X(ORA, IMM, 2), X(ASL, ACC, 2), X(AAC, IMM, 2), X(TOP, ABS, 4), X(ORA, ABS, 4), X(ASL, ABS, 6), X(SLO, ABS, 6), \
+	/* 1 */ X(BPL, REL, 2), X(ORA, IDY, 5), X(KIL, IMP, 2), X(SLO, IDY, 8), X(DOP, ZPX, 4), X(ORA, ZPX, 4), X(ASL, ZPX, 6), X(SLO, ZPX, 6), X(CLC, IMP, 2), X(ORA, ABY, 4), X(NOP, IMP, 2), X(SLO, ABY, 7), X(TOP, ABX, 4), X(ORA, ABX, 4), X(ASL, ABX, 7), X(SLO, ABX, 7), \
+	/* 2 */ X(JSR, ABS, 6), X(AND, IDX, 6), X(KIL, IMP, 2), X(RLA, IDX, 8), X(BIT, ZRP, 3), X(AND, ZRP, 3), X(ROL, ZRP, 5), X(RLA, ZRP, 5), X(PLP, IMP, 4), X(AND, IMM, 2), X(ROL, ACC, 2), X(AAC, IMM, 2), X(BIT, ABS, 4), X(AND, ABS, 4), X(ROL, ABS, 6), X(RLA, ABS, 6), \
+	/* 3 */ X(BMI, REL, 2), X(AND, IDY, 5), X(KIL, IMP, 2), X(RLA, IDY, 8), X(DOP, ZPX, 4), X(AND, ZPX, 4), X(ROL, ZPX, 6), X(RLA, ZPX, 6), X(SEC, IMP, 2), X(AND, ABY, 4), X(NOP, IMP, 2), X(RLA, ABY, 7), X(TOP, ABX, 4), X(AND, ABX, 4), X(ROL, ABX, 7), X(RLA, ABX, 7), \
+\
+	/* 4 */ X(RTI, IMP, 6), X(EOR, IDX, 6), X(KIL, IMP, 2), X(SRE, IDX, 8), X(DOP, ZRP, 3), X(EOR, ZRP, 3), X(LSR, ZRP, 5), X(SRE, ZRP, 5), X(PHA, IMP, 3), X(EOR, IMM, 2), X(LSR, ACC, 2), X(ASR, IMM, 2), X(JMP, ABS, 3), X(EOR, ABS, 4), X(LSR, ABS, 6), X(SRE, ABS, 6), \
+	/* 5 */ X(BVC, REL, 2), X(EOR, IDY, 5), X(KIL, IMP, 2), X(SRE, IDY, 8), X(DOP, ZPX, 4), X(EOR, ZPX, 4), X(LSR, ZPX, 6), X(SRE, ZPX, 6), X(CLI, IMP, 2), X(EOR, ABY, 4), X(NOP, IMP, 2), X(SRE, ABY, 7), X(TOP, ABX, 4), X(EOR, ABX, 4), X(LSR, ABX, 7), X(SRE, ABX, 7), \
+	/* 6 */ X(RTS, IMP, 6), X(ADC, IDX, 6), X(KIL, IMP, 2), X(RRA, IDX, 8), X(DOP, ZRP, 3), X(ADC, ZRP, 3), X(ROR, ZRP, 5), X(RRA, ZRP, 5), X(PLA, IMP, 4), X(ADC, IMM, 2), X(ROR, ACC, 2), X(ARR, IMM, 2), X(JMP, IND, 5), X(ADC, ABS, 4), X(ROR, ABS, 6), X(RRA, ABS, 6), \
+	/* 7 */ X(BVS, REL, 2), X(ADC, IDY, 5), X(KIL, IMP, 2), X(RRA, IDY, 8), X(DOP, ZPX, 4), X(ADC, ZPX, 4), X(ROR, ZPX, 6), X(RRA, ZPX, 6), X(SEI, IMP, 2), X(ADC, ABY, 4), X(NOP, IMP, 2), X(RRA, ABY, 7), X(TOP, ABX, 4), X(ADC, ABX, 4), X(ROR, ABX, 7), X(RRA, ABX, 7), \
+\
+	/* 8 */ X(DOP, IMM, 2), X(STA, IDX, 6), X(DOP, IMM, 2), X(SAX, IDX, 6), X(STY, ZRP, 3), X(STA, ZRP, 3), X(STX, ZRP, 3), X(SAX, ZRP, 3), X(DEY, IMP, 2), X(DOP, IMM, 2), X(TXA, IMP, 2), X(XAA, IMM, 2), X(STY, ABS, 4), X(STA, ABS, 4), X(STX, ABS, 4), X(SAX, ABS, 4), \
+	/* 9 */ X(BCC, REL, 2), X(STA, IDY, 6), X(KIL, IMP, 2), X(AXA, IDY, 6), X(STY, ZPX, 4), X(STA, ZPX, 4), X(STX, ZPY, 4), X(SAX, ZPY, 4), X(TYA, IMP, 2), X(STA, ABY, 5), X(TXS, IMP, 2), X(XAS, ABY, 5), X(SYA, ABX, 5), X(STA, ABX, 5), X(SXA, ABY, 5), X(AXA, ABY, 5), \
+	/* A */ X(LDY, IMM, 2), X(LDA, IDX, 6), X(LDX, IMM, 2), X(LAX, IDX, 6), X(LDY, ZRP, 3), X(LDA, ZRP, 3), X(LDX, ZRP, 3), X(LAX, ZRP, 3), X(TAY, IMP, 2), X(LDA, IMM, 2), X(TAX, IMP, 2), X(ATX, IMM, 2), X(LDY, ABS, 4), X(LDA, ABS, 4), X(LDX, ABS, 4), X(LAX, ABS, 4), \
+	/* B */ X(BCS, REL, 2), X(LDA, IDY, 5), X(KIL, IMP, 2), X(LAX, IDY, 5), X(LDY, ZPX, 4), X(LDA, ZPX, 4), X(LDX, ZPY, 4), X(LAX, ZPY, 4), X(CLV, IMP, 2), X(LDA, ABY, 4), X(TSX, IMP, 2), X(LAR, ABY, 4), X(LDY, ABX, 4), X(LDA, ABX, 4), X(LDX, ABY, 4), X(LAX, ABY, 4), \
+\
+	/* C */ X(CPY, IMM, 2), X(CMP, IDX, 6), X(DOP, IMM, 2), X(DCP, IDX, 8), X(CPY, ZRP, 3), X(CMP, ZRP, 3), X(DEC, ZRP, 5), X(DCP, ZRP, 5), X(INY, IMP, 2), X(CMP, IMM, 2), X(DEX, IMP, 2), X(AXS, IMM, 2), X(CPY, ABS, 4), X(CMP, ABS, 4), X(DEC, ABS, 6), X(DCP, ABS, 6), \
+	/* D */ X(BNE, REL, 2), X(CMP, IDY, 5), X(KIL, IMP, 2), X(DCP, IDY, 8), X(DOP, ZPX, 4), X(CMP, ZPX, 4), X(DEC, ZPX, 6), X(DCP, ZPX, 6), X(CLD, IMP, 2), X(CMP, ABY, 4), X(NOP, IMP, 2), X(DCP, ABY, 7), X(TOP, ABX, 4), X(CMP, ABX, 4), X(DEC, ABX, 7), X(DCP, ABX, 7), \
+	/* E */ X(CPX, IMM, 2), X(SBC, IDX, 6), X(DOP, IMM, 2), X(ISB, IDX, 8), X(CPX, ZRP, 3), X(SBC, ZRP, 3), X(INC, ZRP, 5), X(ISB, ZRP, 5), X(INX, IMP, 2), X(SBC, IMM, 2), X(NOP, IMP, 2), X(SBC, IMM, 2), X(CPX, ABS, 4), X(SBC, ABS, 4), X(INC, ABS, 6), X(ISB, ABS, 6), \
 	/* F */ X(BEQ, REL, 2), X(SBC, IDY, 5), X(KIL, IMP, 2), X(ISB, IDY, 8), X(DOP, ZPX, 4), X(SBC, ZPX, 4), X(INC, ZPX, 6), X(ISB, ZPX, 6), X(SED, IMP, 2), X(SBC, ABY, 4), X(NOP, IMP, 2), X(ISB, ABY, 7), X(TOP, ABX, 4), X(SBC, ABX, 4), X(INC, ABX, 7), X(ISB, ABX, 7),
+
+// Fused addressing mode and operation, so both can be inlined into a single handler.
+// Operands are fetched here unless they were taken from the decode cache.
+template<Cpu::AddrMode addrmode, Cpu::Opcode op, int cycles, bool predecoded>
+void Cpu::Execute() {
+	if constexpr (!predecoded)
+		operand = FetchOperand(pc, OperandBytes(addrmode));
+	cyclesToNextInstruction = cycles;
+	bool extraCyclePossible = (this->*addrmode)();
+	cyclesToNextInstruction += extraCyclePossible & (this->*op)();
+}
+
+constexpr int Cpu::AddrModeBytes(AddrMode addrmode) {
+	if (addrmode == &Cpu::IMP || addrmode == &Cpu::ACC) return 1;
+	if (addrmode == &Cpu::ABS || addrmode == &Cpu::ABX || addrmode == &Cpu::ABY || addrmode == &Cpu::IND) return 3;
+	return 2;
+}
+
+// Immediate operands are read by the operation itself
+constexpr int Cpu::OperandBytes(AddrMode addrmode) {
+	return addrmode == &Cpu::IMM ? 0 : AddrModeBytes(addrmode) - 1;
+}
+
+#define X(op, addrmode, cycles) Cpu::Instruction{ #op, #addrmode, cycles, AddrModeBytes(&Cpu::addrmode), &Cpu::addrmode == &Cpu::ACC }
+constexpr Cpu::Instruction Cpu::instructions[256]
+{
+	CPU_INSTRUCTIONS
 };
 #undef X
 
+#define X(op, addrmode, cycles) &Cpu::Execute<&Cpu::addrmode, &Cpu::op, cycles, false>
+constexpr Cpu::Handler Cpu::handlers[256]
+{
+	CPU_INSTRUCTIONS
+};
+#undef X
 
-Cpu::Instruction::Instruction(
-	std::string opname,
-	Opcode op,
-	std::string addrname,
-	AddrMode addrmode,
-	int cycles
-) :
-	opname(opname),
-	op(op),
-	addrname(addrname),
-	addrmode(addrmode),
-	cycles(cycles),
-	bytes(0) {
-	if (addrmode == &Cpu::IMP) bytes = 1;
-	else if (addrmode == &Cpu::IMM) bytes = 2;
-	else if (addrmode == &Cpu::ACC) bytes = 1;
-	else if (addrmode == &Cpu::ABS) bytes = 3;
-	else if (addrmode == &Cpu::ABX) bytes = 3;
-	else if (addrmode == &Cpu::ABY) bytes = 3;
-	else if (addrmode == &Cpu::ZRP) bytes = 2;
-	else if (addrmode == &Cpu::ZPX) bytes = 2;
-	else if (addrmode == &Cpu::ZPY) bytes = 2;
-	else if (addrmode == &Cpu::REL) bytes = 2;
-	else if (addrmode == &Cpu::IDX) bytes = 2;
-	else if (addrmode == &Cpu::IDY) bytes = 2;
-	else if (addrmode == &Cpu::IND) bytes = 3;
-}
+#define X(op, addrmode, cycles) &Cpu::Execute<&Cpu::addrmode, &Cpu::op, cycles, true>
+constexpr Cpu::Handler Cpu::predecodedHandlers[256]
+{
+	CPU_INSTRUCTIONS
+};
+#undef X
+#undef CPU_INSTRUCTIONS
 
 Cpu::Cpu(Nes& nes) :
 	nes(nes) {
@@ -68,8 +81,7 @@ Cpu::Cpu(Nes& nes) :
 	cyclesToNextInstruction = 8;
 }
 
-Cpu::Cpu(Nes& nes, Savestate& state) :
-	nes(nes) {
+void Cpu::LoadState(Savestate& state) {
 	cyclesToNextInstruction = state.Pop<int32_t>();
 	ra = state.Pop<uint8_t>();
 	rx = state.Pop<uint8_t>();
@@ -77,10 +89,10 @@ Cpu::Cpu(Nes& nes, Savestate& state) :
 	sp = state.Pop<uint8_t>();
 	pc = state.Pop<uint16_t>();
 	status = state.Pop<decltype(status)>();
+	decodeCache.clear();
 }
 
-Savestate Cpu::SaveState() const {
-	Savestate state;
+void Cpu::SaveState(Savestate& state) const {
 	state.Push<int32_t>(cyclesToNextInstruction);
 	state.Push<uint8_t>(ra);
 	state.Push<uint8_t>(rx);
@@ -88,22 +100,59 @@ Savestate Cpu::SaveState() const {
 	state.Push<uint8_t>(sp);
 	state.Push<uint16_t>(pc);
 	state.Push<decltype(status)>(status);
-	return state;
 }
 
 void Cpu::Clock() {
 	if (cyclesToNextInstruction <= 0) {
+		size_t prgOffset;
+		if (nes.predecodeInstructions && nes.GetPrgOffset(pc, prgOffset)) {
+			const auto& decoded = Decode(prgOffset);
+			if (decoded.state == DecodedInstruction::Decoded) {
+				opcode = decoded.opcode;
+				operand = decoded.operand;
+				pc++;
+				(this->*predecodedHandlers[opcode])();
+				cyclesToNextInstruction--;
+				return;
+			}
+		}
+
 		opcode = nes.CpuRead(pc);
-		const auto& instruction = Cpu::instructions[opcode];
 		pc++;
-
-		cyclesToNextInstruction = instruction.cycles;
-		bool extraCyclePossible = (this->*instruction.addrmode)();
-		cyclesToNextInstruction += extraCyclePossible & (this->*instruction.op)();
+		(this->*handlers[opcode])();
 	}
 	cyclesToNextInstruction--;
 }
 
+// PRG ROM is never written, so entries stay valid across bank switches. Instructions that
+// straddle a page boundary are left to the interpreter, as the next page may be switched out.
+const Cpu::DecodedInstruction& Cpu::Decode(size_t prgOffset) {
+	if (prgOffset >= decodeCache.size())
+		decodeCache.resize(prgOffset + 1);
+
+	auto& decoded = decodeCache[prgOffset];
+	if (decoded.state == DecodedInstruction::Empty) {
+		decoded.opcode = nes.CpuRead(pc);
+		int bytes = instructions[decoded.opcode].bytes;
+		if ((pc & 0xFF) + bytes > 0x100) {
+			decoded.state = DecodedInstruction::Uncacheable;
+		} else {
+			decoded.state = DecodedInstruction::Decoded;
+			decoded.operand = FetchOperand(pc + 1, bytes - 1);
+		}
+	}
+	return decoded;
+}
+
+uint16_t Cpu::FetchOperand(uint16_t addr, int bytes) {
+	uint16_t res = 0;
+	if (bytes > 0)
+		res = nes.CpuRead(addr);
+	if (bytes > 1)
+		res |= nes.CpuRead(addr + 1) << 8;
+	return res;
+}
+
 void Cpu::Reset() {
 	pc = JoinBytes(nes.CpuRead(0xFFFC), nes.CpuRead(0xFFFD));
 
@@ -143,6 +192,34 @@ bool Cpu::InstructionComplete() const {
 	return cyclesToNextInstruction == 0;
 }
 
+// Cycles remaining before the next instruction is fetched
+int Cpu::PendingCycles() const {
+	return std::max(cyclesToNextInstruction, 0);
+}
+
+// Equivalent to clocking without reaching the next fetch
+void Cpu::SkipCycles(int cycles) {
+	cyclesToNextInstruction -= cycles;
+}
+
+Cpu::Registers Cpu::GetRegisters() const {
+	return { ra, rx, ry, sp, status.reg, pc, cyclesToNextInstruction };
+}
+
+void Cpu::SetRegisters(const Registers& registers) {
+	ra = registers.ra;
+	rx = registers.rx;
+	ry = registers.ry;
+	sp = registers.sp;
+	status.reg = registers.status;
+	pc = registers.pc;
+	cyclesToNextInstruction = registers.cyclesToNextInstruction;
+}
+
+uint16_t Cpu::GetPc() const {
+	return pc;
+}
+
 void Cpu::ReadAddr() {
 	data = nes.CpuRead(addr);
 }
@@ -182,14 +259,14 @@ bool Cpu::IMM() {
 
 // Follow the address formed by the next 2 bytes
 bool Cpu::ABS() {
-	addr = JoinBytes(nes.CpuRead(pc), nes.CpuRead(pc + 1));
+	addr = operand;
 	pc += 2;
 	return false;
 }
 
 // Follow the address formed by the next 2 bytes added to X
 bool Cpu::ABX() {
-	uint16_t tempAddr = JoinBytes(nes.CpuRead(pc), nes.CpuRead(pc + 1));
+	uint16_t tempAddr = operand;
 	addr = tempAddr + rx;
 	pc += 2;
 	return PageChanged(tempAddr, addr);
@@ -197,7 +274,7 @@ bool Cpu::ABX() {
 
 // Follow the address formed by the next 2 bytes added to Y
 bool Cpu::ABY() {
-	uint16_t tempAddr = JoinBytes(nes.CpuRead(pc), nes.CpuRead(pc + 1));
+	uint16_t tempAddr = operand;
 	addr = tempAddr + ry;
 	pc += 2;
 	return PageChanged(tempAddr, addr);
@@ -205,21 +282,21 @@ bool Cpu::ABY() {
 
 // Follow the address formed by the next byte
 bool Cpu::ZRP() {
-	addr = nes.CpuRead(pc);
+	addr = operand;
 	pc++;
 	return false;
 }
 
 // Follow zero page the address formed by the next byte added to X
 bool Cpu::ZPX() {
-	addr = (nes.CpuRead(pc) + rx) & 0xFF;
+	addr = (operand + rx) & 0xFF;
 	pc++;
 	return false;
 }
 
 // Follow zero page the address formed by the next byte added to Y
 bool Cpu::ZPY() {
-	addr = (nes.CpuRead(pc) + ry) & 0xFF;
+	addr = (operand + ry) & 0xFF;
 	pc++;
 	return false;
 }
@@ -232,14 +309,14 @@ bool Cpu::ACC() {
 
 // Used by branch instructions. Add next byte (signed) to pc to get new pc
 bool Cpu::REL() {
-	addr = static_cast<int8_t>(nes.CpuRead(pc)) + pc + 1;
+	addr = static_cast<int8_t>(operand) + pc + 1;
 	pc++;
 	return PageChanged(pc + 1, addr);
 }
 
 // Add X to the next byte to get a zero page address. The data is pointed to by the 2 byte address at this address
 bool Cpu::IDX() {
-	uint8_t zpAddr = nes.CpuRead(pc) + rx;
+	uint8_t zpAddr = operand + rx;
 	pc++;
 	addr = JoinBytes(nes.CpuRead(zpAddr), nes.CpuRead((zpAddr + 1) & 0xFF));
 	return false;
@@ -247,7 +324,7 @@ bool Cpu::IDX() {
 
 // Follow the next one byte address to get a two byte zero page address. The data is pointed to by this address added to Y. 
 bool Cpu::IDY() {
-	uint8_t zpAddr = nes.CpuRead(pc);
+	uint8_t zpAddr = operand;
 	pc++;
 	uint16_t tmp = JoinBytes(nes.CpuRead(zpAddr), nes.CpuRead((zpAddr + 1) & 0xFF));
 	addr = tmp + ry;
@@ -256,7 +333,7 @@ bool Cpu::IDY() {
 
 // Used by JMP. Jump to the location pointed to by the next 2 bytes
 bool Cpu::IND() {
-	addr = JoinBytes(nes.CpuRead(pc), nes.CpuRead(pc + 1));
+	addr = operand;
 	addr = JoinBytes(nes.CpuRead(addr), nes.CpuRead(((addr + 1) & 0xFF) | (addr & 0xFF00)));
 	return false;
 }
@@ -285,7 +362,7 @@ bool Cpu::AND() {
 bool Cpu::ASL() {
 	uint8_t res;
 	bool carry;
-	if (instructions[opcode].addrmode == &Cpu::ACC) {
+	if (instructions[opcode].accumulator) {
 		carry = ra & 0x80;
 		res = ra << 1;
 		ra = res;
@@ -518,7 +595,7 @@ bool Cpu::LDY() {
 bool Cpu::LSR() {
 	uint8_t res;
 	bool carry;
-	if (instructions[opcode].addrmode == &Cpu::ACC) {
+	if (instructions[opcode].accumulator) {
 		carry = ra & 1;
 		res = ra >> 1;
 		ra = res;
@@ -605,7 +682,7 @@ bool Cpu::INY() {
 bool Cpu::ROL() {
 	uint8_t res;
 	bool carry;
-	if (instructions[opcode].addrmode == &Cpu::ACC) {
+	if (instructions[opcode].accumulator) {
 		carry = ra & 0x80;
 		res = (ra << 1) | static_cast<uint8_t>(status.c);
 		ra = res;
@@ -624,7 +701,7 @@ bool Cpu::ROL() {
 bool Cpu::ROR() {
 	uint8_t res;
 	bool carry;
-	if (instructions[opcode].addrmode == &Cpu::ACC) {
+	if (instructions[opcode].accumulator) {
 		carry = ra & 0x01;
 		res = (ra >> 1) | (status.c << 7);
 		ra = res;
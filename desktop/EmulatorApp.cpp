@@ -180,7 +180,7 @@ bool EmulatorApp::OnUpdate() {
 			SetInputEnabled(false);
 		}
 
-		if (!client)
+		if (!client && nes->HasCartridgeLoaded())
 			for (int i = 0; i < 10; i++)
 				if (GetKeyDown(Key::Keyboard((SDL_Scancode)(SDL_SCANCODE_1 + i)))) {
 					LoadState(i);
@@ -288,7 +288,7 @@ bool EmulatorApp::OnUpdate() {
 	overlay->Update();
 
 	// Update emulation
-	std::vector<int16_t> audioSamples;
+	audioSamples.clear();
 	if (!client && nes->HasCartridgeLoaded()) {
 		if (menuState != MenuState::None)
 			SetInputEnabled(false);
@@ -297,42 +297,57 @@ bool EmulatorApp::OnUpdate() {
 			0.125f, 0.25f, 0.5f,
 			1.0f, 2.0f, 4.0f, 8.0f,
 		};
-		emulationStep += step[emulationSpeed] * float(!paused);
-		while (emulationStep >= 1.0f) {
-			emulationStep -= 1.0f;
-			nes->ClockFrame();
+		bool rewinding = rewindEnabled && menuState == MenuState::None && GetKey(Key::Keyboard(SDL_SCANCODE_BACKSPACE));
+
+		// Audio is made at the rate it is played back at when speeding up, and not at all when
+		// nobody will hear it
+		float speed = step[emulationSpeed];
+		bool heard = (!mute && volume != 0) || (bool)server;
+		nes->audioSampleRate = heard && !rewinding ? int(AUDIO_SAMPLE_RATE / std::max(speed, 1.0f)) : 0;
+
+		Stopwatch<> frameCostTimer;
+		int frames = 0;
+		bool skipped = false;
+		if (rewinding) {
+			// Step back one recorded state per update, and run it for a frame to show it
+			if (rewind.Pop(rewindState)) {
+				Savestate state = rewindState;
+				if (nes->LoadState(state))
+					nes->ClockFrame();
+			}
+			nes->TakeAudioSamples();
+		} else {
+			// Only the last frame of this update is shown, unless the host is too slow to draw it
+			bool draw = framesSkipped >= frameSkip;
+			emulationStep += speed * float(!paused);
+			while (emulationStep >= 1.0f) {
+				emulationStep -= 1.0f;
+				nes->ClockFrame(draw && emulationStep < 1.0f);
+				frames++;
+			}
+			skipped = frames && !draw;
+			if (rewindEnabled && frames)
+				rewind.Push([&](Savestate& state) { return nes->SaveStateSince(state); });
+			if (nes->audioSampleRate) {
+				// Played back at the output rate, so faster emulation sounds higher
+				resampler.SetRatio(speed * nes->audioSampleRate / AUDIO_SAMPLE_RATE);
+				resampler.Process(nes->TakeAudioSamples(), audioSamples);
+			} else {
+				nes->TakeAudioSamples();
+			}
 		}
 		screenBuffer = &nes->GetScreenBuffer();
-		audioSamples = nes->TakeAudioSamples();
 
-		auto rgba = NesInterface::ToRgba(*screenBuffer);
-		screen->SetPixels(rgba.data());
+		if (!skipped) {
+			auto rgba = NesInterface::ToRgba(*screenBuffer);
+			screen->SetPixels(rgba.data());
+		}
+		if (frames)
+			UpdateFrameSkip(frameCostTimer.Time(), !skipped);
 
 		SetInputEnabled(true);
 	}
 
-	auto scaleAudio = [](const std::vector<int16_t>& samples, size_t targetSamples) {
-		std::vector<int16_t> out(targetSamples);
-		if (!samples.empty()) {
-			if (samples.size() <= targetSamples) {
-				// Scale up
-				for (size_t i = 0; i < out.size(); i++) {
-					float m = (float)i / out.size();
-					out.at(i) = samples.at(size_t(m * samples.size()));
-				}
-			} else if (samples.size() > targetSamples) {
-				// Scale down
-				for (size_t i = 0; i < samples.size(); i++) {
-					float m = (float)i / samples.size();
-					out.at(size_t(m* out.size())) = samples.at(i);
-				}
-			}
-		}
-		return out;
-	};
-	audioSamples = scaleAudio(audioSamples, nes->audioSampleRate / targetFps);
-
-
 	// Update network
 	if (server) {
 		if (!nes->HasCartridgeLoaded())
@@ -402,6 +417,19 @@ bool EmulatorApp::OnUpdate() {
 	return !quit;
 }
 
+// Keeps running averages of what updates that draw and updates that don't cost, and skips drawing
+// as many updates in a row as it takes for them to fit in a frame on average
+void EmulatorApp::UpdateFrameSkip(float cost, bool drawn) {
+	float& average = drawn ? drawnFrameCost : skippedFrameCost;
+	average += (cost - average) * 0.1f;
+	framesSkipped = drawn ? 0 : framesSkipped + 1;
+
+	float budget = 1.0f / targetFps;
+	frameSkip = 0;
+	while (frameSkip < MAX_FRAME_SKIP && drawnFrameCost + frameSkip * skippedFrameCost > budget * (frameSkip + 1))
+		frameSkip++;
+}
+
 void EmulatorApp::OnQuit() {
 	OnSuspend();
 }
@@ -512,7 +540,7 @@ void EmulatorApp::UpdateMenu() {
 				third = MenuNode{};
 				third.text = "Slot " + std::to_string(i + 1);
 				third.onclick = [=] { LoadState(i); };
-				third.enabled = SaveStateExists(i);
+				third.enabled = nes->HasCartridgeLoaded() && SaveStateExists(i);
 				third.shortcut = std::string("Ctrl+") + "1234567890"[i];
 				third.closeAfterClick = true;
 				pushThird();
@@ -566,6 +594,32 @@ void EmulatorApp::UpdateMenu() {
 		}
 		pushSecond();
 
+		second = MenuNode{};
+		second.text = "Run-Ahead"; {
+
+			const char* text[] = {
+					"Off", "1 frame", "2 frames", "3 frames",
+			};
+
+			for (int i = 0; i < 4; i++) {
+				third = MenuNode{};
+				third.text = text[i];
+				third.onclick = [=] { nes->runAhead = i; };
+				third.checked = i == nes->runAhead;
+				third.checkMode = CheckMode::Radio;
+				pushThird();
+			}
+		}
+		pushSecond();
+
+		second = MenuNode{};
+		second.text = "Rewind";
+		second.onclick = [&] { rewindEnabled = !rewindEnabled; rewind.Clear(); };
+		second.checked = rewindEnabled;
+		second.checkMode = CheckMode::Checkable;
+		second.shortcut = "Backspace";
+		pushSecond();
+
 		second = MenuNode{};
 		second.text = "Disable BG";
 		second.onclick = [&] { nes->masterBg = !nes->masterBg; };
@@ -918,6 +972,9 @@ void EmulatorApp::SaveIni() const {
 	j["show-network"] = overlay->showNetwork;
 	j["paused"] = paused;
 	j["speed"] = emulationSpeed;
+	j["run-ahead"] = nes->runAhead;
+	j["rewind"] = rewindEnabled;
+	j["rewind-memory"] = int(rewind.memoryBudget >> 20);
 	j["disable-bg"] = !nes->masterBg;
 	j["disable-fg"] = !nes->masterFg;
 	j["greyscale"] = nes->masterGreyscale;
@@ -1027,6 +1084,9 @@ void EmulatorApp::LoadIni(bool reset) {
 	overlay->showNetwork = getBool(j, "show-network", false);
 	paused = getBool(j, "paused", false);
 	emulationSpeed = clamp(getInt(j, "speed", 3), 0, 6);
+	nes->runAhead = clamp(getInt(j, "run-ahead", 0), 0, 3);
+	rewindEnabled = getBool(j, "rewind", false);
+	rewind.memoryBudget = size_t(clamp(getInt(j, "rewind-memory", 8), 1, 1024)) << 20;
 	nes->masterBg = !getBool(j, "disable-bg", false);
 	nes->masterFg = !getBool(j, "disable-fg", false);
 	nes->masterGreyscale = getBool(j, "greyscale", false);
@@ -1127,6 +1187,7 @@ void EmulatorApp::LoadRom(const std::string& path) {
 	File::ReadFromFile(GetAppdataPath() + "Sram/" + name + ".sram", sram);
 
 	nes->InsertCartridge(std::make_unique<Cartridge>(name, rom, sram));
+	rewind.Clear();
 
 	// Update recents list
 	auto it = std::find(recentRoms.begin(), recentRoms.end(), path);
@@ -1143,6 +1204,7 @@ void EmulatorApp::LoadRom(const std::string& path) {
 void EmulatorApp::CloseRom() {
 	SaveSram();
 	nes->InsertCartridge(nullptr);
+	rewind.Clear();
 	UpdateMenu();
 
 	SaveIni();
@@ -1451,7 +1513,7 @@ void EmulatorApp::LoadState(int slot) {
 	} else {
 		Savestate state = data;
 		if (!nes->LoadState(state)) {
-			ErrorMessage("Savestate is invalid.", this);
+			ErrorMessage("Savestate is invalid, or is for another ROM.", this);
 		} else {
 			UpdateMenu();
 		}
@@ -2,10 +2,13 @@
 #include "Application.h"
 #include "Network.h"
 #include "Nes.h"
+#include "Rewind.h"
 #include "Stopwatch.h"
 #include "Controller.h"
+#include "Resampler.h"
 #include "File.h"
 #include <string>
+#include <algorithm>
 #include <iostream>
 #include <memory>
 #include <thread>
@@ -119,6 +122,9 @@ struct HeadlessProperties {
     float emulationStep = 0.0f;
     const std::vector<uint8_t>* screenBuffer = nullptr;
     bool pause = false;
+    Rewind rewind{ 8 << 20 };
+    Resampler resampler;
+    std::vector<int16_t> audioSamples;
 };
 
 static const std::string& GetAppdataPath() {
@@ -229,6 +235,11 @@ static void SaveState(Nes& nes, const std::string& slotName) {
 }
 
 static void LoadState(Nes& nes, const std::string& slotName) {
+    if (!nes.HasCartridgeLoaded()) {
+        std::cout << "No ROM open" << std::endl;
+        return;
+    }
+
     int slot = -1;
     try { slot = std::stoi(slotName); } catch (std::exception&) {}
     if (slot < 0) {
@@ -242,7 +253,7 @@ static void LoadState(Nes& nes, const std::string& slotName) {
     } else {
         Savestate state = data;
         if (!nes.LoadState(state)) {
-            std::cout << "Savestate is invalid." << std::endl;
+            std::cout << "Savestate is invalid, or is for another ROM." << std::endl;
         }
     }
 }
@@ -276,6 +287,44 @@ static void SetSpeed(HeadlessProperties& prop, const std::string& arg) {
     }
 }
 
+static void SetRunAhead(Nes& nes, const std::string& arg) {
+    int frames = -1;
+    try { frames = std::stoi(arg); }
+    catch (std::exception&) { }
+    if (frames < 0) {
+        std::cout << "Invalid argument" << std::endl;
+        return;
+    }
+    // Each frame run ahead is emulated again every frame, so keep to the desktop's range
+    nes.runAhead = std::min(frames, 3);
+}
+
+static void RewindSeconds(Nes& nes, HeadlessProperties& prop, const std::string& arg) {
+    float seconds = -1.0f;
+    try { seconds = std::stof(arg); }
+    catch (std::exception&) { }
+    if (seconds < 0.0f) {
+        std::cout << "Invalid argument" << std::endl;
+        return;
+    }
+
+    std::vector<uint8_t> data;
+    bool popped = false;
+    for (int i = 0; i < int(seconds * 60.0f) && prop.rewind.Pop(data); i++)
+        popped = true;
+    if (popped) {
+        Savestate state = data;
+        nes.LoadState(state);
+    }
+}
+
+static void ToggleCoreComparison(Nes& nes, const std::string& arg) {
+    bool enable{};
+    if (!GetToggleArg(arg, enable))
+        return;
+    nes.compareCpuCores = enable;
+}
+
 static void ToggleBackground(Nes& nes, const std::string& arg) {
     bool enable{};
     if (!GetToggleArg(arg, enable))
@@ -318,6 +367,9 @@ static void PrintHelp() {
     std::cout << "\tpause                   Pauses emulation.\n";
     std::cout << "\tunpause                 Unpauses emulation.\n";
     std::cout << "\tspeed <multiplier>      Sets emulation speed.\n";
+    std::cout << "\trunahead <0-3>          Shows frames this far ahead to hide input lag.\n";
+    std::cout << "\trewind <seconds>        Steps emulation back in time.\n";
+    std::cout << "\tcomparecores <on|off>   Runs each frame on both CPU cores and pauses if they differ.\n";
     std::cout << "\tbackground <on|off>     Toggles background graphics.\n";
     std::cout << "\tforeground <on|off>     Toggles foreground graphics.\n";
     std::cout << "\tgreyscale  <on|off>     Toggles greyscale mode.\n";
@@ -340,8 +392,10 @@ static void HandleCommand(Nes& nes, HeadlessProperties& prop, const std::string&
     } else if (isCmd("open")) {
         CloseRom(nes, false);
         LoadRom(nes, arg);
+        prop.rewind.Clear();
     } else if (cmd == "close") {
         CloseRom(nes, true);
+        prop.rewind.Clear();
     } else if (cmd == "savesram") {
         SaveSram(nes);
     } else if (isCmd("clearsram")) {
@@ -358,6 +412,12 @@ static void HandleCommand(Nes& nes, HeadlessProperties& prop, const std::string&
         prop.pause = false;
     } else if (isCmd("speed")) {
         SetSpeed(prop, arg);
+    } else if (isCmd("runahead")) {
+        SetRunAhead(nes, arg);
+    } else if (isCmd("rewind")) {
+        RewindSeconds(nes, prop, arg);
+    } else if (isCmd("comparecores")) {
+        ToggleCoreComparison(nes, arg);
     } else if (isCmd("background")) {
         ToggleBackground(nes, arg);
     } else if (isCmd("foreground")) {
@@ -451,43 +511,38 @@ void RunHeadless(int argc, char** argv) {
         }
 
         // Update emulation
-        std::vector<int16_t> audioSamples;
+        prop.audioSamples.clear();
         constexpr float FRAME_DURATION = 1.0f / 60.0f;
         prop.emulationStep += prop.emulationSpeed * sw.Time();
+        // Audio is made at the rate it is sent at when speeding up, and not at all while nothing
+        // is sent. Clients have no way to say they are muted, so any connected one is sent it.
+        bool sending = connectionCount && !prop.pause;
+        nes.audioSampleRate = sending ? int(Application::AUDIO_SAMPLE_RATE / std::max(prop.emulationSpeed, 1.0f)) : 0;
         sw.Restart();
         while (prop.emulationStep >= FRAME_DURATION) {
             prop.emulationStep -= FRAME_DURATION;
             if (connectionCount && !prop.pause) {
                 if (nes.HasCartridgeLoaded()) {
-                    nes.ClockFrame();
+                    // Frames that are behind the clock are not sent, so only the last one is drawn
+                    try {
+                        nes.ClockFrame(prop.emulationStep < FRAME_DURATION);
+                    } catch (std::logic_error& ex) {
+                        std::cout << "\n" << ex.what() << " Comparison turned off and emulation paused.\n>" << std::flush;
+                        nes.compareCpuCores = false;
+                        prop.pause = true;
+                    }
+                    prop.rewind.Push([&](Savestate& state) { return nes.SaveStateSince(state); });
                 }
             }
 
             if (nes.HasCartridgeLoaded()) {
                 prop.screenBuffer = &nes.GetScreenBuffer();
-                auto samples = nes.TakeAudioSamples();
-
-                auto scaleAudio = [](const std::vector<int16_t>& samples, size_t targetSamples) {
-                    std::vector<int16_t> out(targetSamples);
-                    if (!samples.empty()) {
-                        if (samples.size() <= targetSamples) {
-                            // Scale up
-                            for (size_t i = 0; i < out.size(); i++) {
-                                float m = (float)i / out.size();
-                                out.at(i) = samples.at(size_t(m * samples.size()));
-                            }
-                        } else if (samples.size() > targetSamples) {
-                            // Scale down
-                            for (size_t i = 0; i < samples.size(); i++) {
-                                float m = (float)i / samples.size();
-                                out.at(size_t(m * out.size())) = samples.at(i);
-                            }
-                        }
-                    }
-                    return out;
-                };
-                samples = scaleAudio(samples, size_t(nes.audioSampleRate / 60 / prop.emulationSpeed));
-                audioSamples.insert(audioSamples.end(), samples.begin(), samples.end());
+                if (nes.audioSampleRate) {
+                    prop.resampler.SetRatio(prop.emulationSpeed * nes.audioSampleRate / Application::AUDIO_SAMPLE_RATE);
+                    prop.resampler.Process(nes.TakeAudioSamples(), prop.audioSamples);
+                } else {
+                    nes.TakeAudioSamples();
+                }
             }
         }
 
@@ -497,9 +552,79 @@ void RunHeadless(int argc, char** argv) {
 
         // Update network
         server->Update(*prop.screenBuffer);
-        if (audioSamples.size())
-            server->SendAudio(audioSamples);
+        if (prop.audioSamples.size())
+            server->SendAudio(prop.audioSamples);
     }
 
     Cleanup();
 }
+
+// Holds the buttons a player would to get past title screens and move about
+struct ScriptedNesInput : public InputSource<NesKey> {
+    bool GetKey(NesKey key) const {
+        switch (key) {
+        case NesKey::Start: return frame % 300 < 4;
+        case NesKey::Right: return frame % 120 < 90;
+        case NesKey::A: return frame % 40 < 12;
+        case NesKey::B: return true;
+        default: return false;
+        }
+    }
+    int frame = 0;
+};
+
+int RunCoreComparison(int argc, char** argv) {
+    if (!InitConsole()) {
+        Application::ErrorMessage("Failed to initialize console");
+        return -1;
+    }
+
+    int frames = 3600;
+    if (argc >= 3) {
+        try {
+            frames = std::stoi(argv[2]);
+        } catch (std::exception&) {}
+    }
+
+    std::vector<std::string> paths;
+    std::error_code ec;
+    for (const auto& entry : fs::directory_iterator(GetAppdataPath() + "Roms", ec))
+        if (entry.path().extension() == ".nes")
+            paths.push_back(entry.path().string());
+    std::sort(paths.begin(), paths.end());
+    if (paths.empty())
+        std::cout << "No ROMs found in " << GetAppdataPath() << "Roms" << std::endl;
+
+    size_t failures = 0;
+    for (const auto& path : paths) {
+        std::string name = File::GetFilenameWithoutExtension(path);
+        std::vector<uint8_t> rom;
+        if (!File::ReadFromFile(path, rom)) {
+            std::cout << "Cannot open file " << path << std::endl;
+            failures++;
+            continue;
+        }
+
+        ScriptedNesInput input;
+        Nes nes;
+        nes.compareCpuCores = true;
+        int frame = 0;
+        try {
+            nes.InsertCartridge(std::make_unique<Cartridge>(name, rom, std::vector<uint8_t>()));
+            nes.SetController(0, std::make_unique<NesController>(input));
+            for (; frame < frames; frame++) {
+                input.frame = frame;
+                nes.ClockFrame(false);
+                nes.TakeAudioSamples();
+            }
+            std::cout << "OK    " << name << std::endl;
+        } catch (std::exception& ex) {
+            std::cout << "FAIL  " << name << " at frame " << frame << ": " << ex.what() << std::endl;
+            failures++;
+        }
+    }
+
+    std::cout << paths.size() - failures << "/" << paths.size() << " ROMs ran the same on both CPU cores" << std::endl;
+    CleanupConsole();
+    return failures ? 1 : 0;
+}
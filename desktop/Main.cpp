@@ -18,6 +18,8 @@ int main(int argc, char** argv) {
 #endif
 		if (argc >= 2 && std::strcmp(argv[1], "-headless") == 0) {
 			RunHeadless(argc, argv);
+		} else if (argc >= 2 && std::strcmp(argv[1], "-comparecores") == 0) {
+			return RunCoreComparison(argc, argv);
 		} else {
 			EmulatorApp app;
 			app.SetCommandLine(argc, argv);
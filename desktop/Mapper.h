@@ -1,7 +1,10 @@
 #pragma once
+#include <array>
 #include <cstdint>
+#include <memory>
 #include <vector>
 #include "Savestate.h"
+#include "DirtyPages.h"
 
 enum class MirrorMode : int32_t
 {
@@ -16,30 +19,86 @@ class Mapper
 {
 public:
 	virtual ~Mapper() = default;
-	virtual Savestate SaveState() const;
+	virtual void SaveState(Savestate& state) const;
+	virtual void LoadState(Savestate& state);
 	int MapperNumber() const;
 
 	virtual bool MapCpuRead(uint16_t& addr, uint8_t& data, bool readonly = false);
 	virtual bool MapCpuWrite(uint16_t& addr, uint8_t data);
-	virtual bool MapPpuRead(uint16_t& addr, uint8_t& data, bool readonly = false);
-	virtual bool MapPpuWrite(uint16_t& addr, uint8_t data);
 	virtual void Reset();
 	virtual MirrorMode GetMirrorMode() const;
-	virtual bool GetIrq() const;
-	virtual void ClearIrq();
+	bool GetIrq() const { return irq; }
+	void ClearIrq() { irq = false; }
 	virtual void CountScanline();
 	const std::vector<uint8_t>& GetSram() const;
+	std::vector<uint8_t>& GetSram();
 	void SetSram(std::vector<uint8_t> data);
+	void LoadSram(Savestate& state);
+
+	// Pages of CHR and SRAM written, see DirtyPages. Only SRAM is ever mapped writable for the CPU.
+	DirtyPages& GetChrPages() { return chrPages; }
+	DirtyPages& GetSramPages() { return sramPages; }
+	void SetEpoch(uint32_t epoch);
+
+	// For in-memory snapshots. CopyState takes the registers of a mapper of the same type on the
+	// same cartridge, and rebuilds the page tables from them. SRAM is left to Cartridge::Snapshot,
+	// which copies only the pages written.
+	virtual std::unique_ptr<Mapper> Clone() const = 0;
+	virtual void CopyState(const Mapper& other) = 0;
+
+	// Memory backing the 256 byte CPU page containing addr, or nullptr if it must go through MapCpuRead/MapCpuWrite
+	const uint8_t* GetCpuReadPage(uint16_t addr) const { return cpuReadPages[addr >> 8]; }
+	uint8_t* GetCpuWritePage(uint16_t addr) const { return cpuWritePages[addr >> 8]; }
+	bool GetPrgOffset(uint16_t addr, size_t& offset) const;
+
+	// Memory backing the 1KB PPU page containing addr below $2000, or nullptr if nothing is mapped there
+	uint8_t* GetChrPage(uint16_t addr) const { return chrReadPages[addr >> 10]; }
+	bool GetChrOffset(uint16_t addr, size_t& offset) const;
+	void WriteChr(uint16_t addr, uint8_t data);
+
+	// A row of 8 pixels of a tile, with the lo plane byte at the address it was requested from
+	struct ChrRow
+	{
+		uint8_t lo = 0;
+		uint8_t hi = 0;
+		uint8_t flippedLo = 0;
+		uint8_t flippedHi = 0;
+		uint16_t pixels = 0;
+		bool decoded = false;
+
+		// 2 bits per pixel, leftmost pixel in the top bits
+		static uint16_t Interleave(uint8_t lo, uint8_t hi);
+	};
+	const ChrRow& GetChrRow(uint16_t addr);
+	void InvalidateChrRows();
 protected:
-	Mapper(int mapperNumber, int prgChunks, int chrChunks, std::vector<uint8_t>& prg, std::vector<uint8_t>& chr);
-	Mapper(Savestate& state, std::vector<uint8_t>& prg, std::vector<uint8_t>& chr);
+	Mapper(int mapperNumber, int prgChunks, int chrChunks, const std::vector<uint8_t>& prg, std::vector<uint8_t>& chr);
+	Mapper(const Mapper& other);
+	Mapper& operator=(const Mapper& other);
 	bool MapCpuRead(uint32_t addr, uint8_t& data);
-	bool MapCpuWrite(uint32_t addr, uint8_t data);
-	std::vector<uint8_t>& prg;
+	void MapCpuPages(uint16_t addr, size_t size, uint8_t* data, bool writable);
+	void MapPrgPages(uint16_t addr, size_t size, size_t prgOffset);
+	void UnmapCpuPages(uint16_t addr, size_t size);
+	void MapChrPages(uint16_t addr, size_t size, size_t chrOffset, bool writable);
+	const std::vector<uint8_t>& prg;
 	std::vector<uint8_t>& chr;
 	int mapperNumber;
 	int prgChunks;
 	int chrChunks;
 	std::vector<uint8_t> sram;
 	size_t sramSize = 0;
+	bool irq = false;
+private:
+	std::array<const uint8_t*, 0x100> cpuReadPages{};
+	std::array<uint8_t*, 0x100> cpuWritePages{};
+
+	std::array<uint8_t*, 8> chrReadPages{};
+	std::array<uint8_t*, 8> chrWritePages{};
+
+	// Rows decoded on first use, indexed by tile * 8 + row, until CHR RAM under them is written
+	std::vector<ChrRow> chrRows;
+	void InitChrPages();
+
+	DirtyPages chrPages;
+	DirtyPages sramPages;
 };
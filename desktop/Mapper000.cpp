@@ -1,11 +1,8 @@
 #include "Mapper000.h"
 
-Mapper000::Mapper000(int mapperNumber, int prgChunks, int chrChunks, std::vector<uint8_t>& prg, std::vector<uint8_t>& chr) :
+Mapper000::Mapper000(int mapperNumber, int prgChunks, int chrChunks, const std::vector<uint8_t>& prg, std::vector<uint8_t>& chr) :
 	Mapper(mapperNumber, prgChunks, chrChunks, prg, chr) {
-}
-
-Mapper000::Mapper000(Savestate& state, std::vector<uint8_t>& prg, std::vector<uint8_t>& chr) :
-	Mapper(state, prg, chr) {
+	UpdatePages();
 }
 
 bool Mapper000::MapCpuRead(uint16_t& addr, uint8_t& data, bool readonly) {
@@ -20,3 +17,17 @@ bool Mapper000::MapCpuRead(uint16_t& addr, uint8_t& data, bool readonly) {
 bool Mapper000::MapCpuWrite(uint16_t& addr, uint8_t data) {
 	return false;
 }
+
+std::unique_ptr<Mapper> Mapper000::Clone() const {
+	return std::make_unique<Mapper000>(*this);
+}
+
+void Mapper000::CopyState(const Mapper& other) {
+	*this = static_cast<const Mapper000&>(other);
+	UpdatePages();
+}
+
+void Mapper000::UpdatePages() {
+	MapPrgPages(0x8000, 0x4000, 0);
+	MapPrgPages(0xC000, 0x4000, prgChunks > 1 ? 0x4000 : 0);
+}
@@ -1,6 +1,6 @@
 #include "Mapper001.h"
 
-Mapper001::Mapper001(int mapperNumber, int prgChunks, int chrChunks, std::vector<uint8_t>& prg, std::vector<uint8_t>& chr) :
+Mapper001::Mapper001(int mapperNumber, int prgChunks, int chrChunks, const std::vector<uint8_t>& prg, std::vector<uint8_t>& chr) :
 	Mapper(mapperNumber, prgChunks, chrChunks, prg, chr)
 {
 	sramSize = 0x2000;
@@ -8,32 +8,29 @@ Mapper001::Mapper001(int mapperNumber, int prgChunks, int chrChunks, std::vector
 	Reset();
 }
 
-Mapper001::Mapper001(Savestate& state, std::vector<uint8_t>& prg, std::vector<uint8_t>& chr) :
-	Mapper(state, prg, chr)
-{
-	sramSize = 0x2000;
-	sram.resize(sramSize);
-
+void Mapper001::LoadState(Savestate& state) {
+	Mapper::LoadState(state);
 	shift = state.Pop<uint8_t>();
 	chrLo = state.Pop<uint8_t>();
 	chrHi = state.Pop<uint8_t>();
 	prgLo = state.Pop<uint8_t>();
 	ctrl = state.Pop<decltype(ctrl)>();
+	UpdatePages();
 }
 
-Savestate Mapper001::SaveState() const {
-	Savestate state = Mapper::SaveState();
+void Mapper001::SaveState(Savestate& state) const {
+	Mapper::SaveState(state);
 	state.Push<uint8_t>(shift);
 	state.Push<uint8_t>(chrLo);
 	state.Push<uint8_t>(chrHi);
 	state.Push<uint8_t>(prgLo);
 	state.Push<decltype(ctrl)>(ctrl);
-	return state;
 }
 
 void Mapper001::Reset() {
 	shift = 0b10000;
 	ctrl.prgBankMode = 3;
+	UpdatePages();
 }
 
 MirrorMode Mapper001::GetMirrorMode() const {
@@ -84,6 +81,7 @@ bool Mapper001::MapCpuRead(uint16_t& addr, uint8_t& data, bool readonly) {
 bool Mapper001::MapCpuWrite(uint16_t& addr, uint8_t data) {
 	if (addr >= 0x6000 && addr < 0x8000) {
 		sram[addr - 0x6000] = data;
+		GetSramPages().Mark(addr - 0x6000);
 		return true;
 	} else if (addr >= 0x8000) {
 		if (data & 0x80) {
@@ -108,44 +106,43 @@ bool Mapper001::MapCpuWrite(uint16_t& addr, uint8_t data) {
 					break;
 				}
 				shift = 0b10000;
+				UpdatePages();
 			}
 		}
 	}
 	return false;
 }
 
-bool Mapper001::MapPpuAddr(uint16_t& addr, uint32_t& newAddr) const {
-	newAddr = addr;
-	if (addr < 0x2000) {
-		if (ctrl.chrBankMode == 0) {
-			newAddr = ((chrLo & 0b1111'1110) * 0x1000) + (addr & 0x1FFF);
-		} else {
-			if (addr < 0x1000)
-				newAddr = (chrLo * 0x1000) + (addr & 0x0FFF);
-			else
-				newAddr = (chrHi * 0x1000) + (addr & 0x0FFF);
-		}
-		return true;
-	}
-	return false;
+std::unique_ptr<Mapper> Mapper001::Clone() const {
+	return std::make_unique<Mapper001>(*this);
 }
 
-bool Mapper001::MapPpuRead(uint16_t& addr, uint8_t& data, bool readonly) {
-	uint32_t newAddr;
-	if (MapPpuAddr(addr, newAddr)) {
-		if (newAddr < chr.size())
-			data = chr[newAddr];
-		return true;
-	}
-	return false;
+void Mapper001::CopyState(const Mapper& other) {
+	*this = static_cast<const Mapper001&>(other);
+	UpdatePages();
 }
 
-bool Mapper001::MapPpuWrite(uint16_t& addr, uint8_t data) {
-	uint32_t newAddr;
-	if (MapPpuAddr(addr, newAddr)) {
-		if (newAddr < chr.size())
-			chr[newAddr] = data;
-		return true;
+void Mapper001::UpdatePages() {
+	uint8_t bank = prgLo & 0x0F;
+	switch (ctrl.prgBankMode) {
+	case 0:
+	case 1:
+		MapPrgPages(0x8000, 0x8000, (bank & 0b1111'1110) * 0x4000);
+		break;
+	case 2:
+		MapPrgPages(0x8000, 0x4000, 0);
+		MapPrgPages(0xC000, 0x4000, bank * 0x4000);
+		break;
+	case 3:
+		MapPrgPages(0x8000, 0x4000, bank * 0x4000);
+		MapPrgPages(0xC000, 0x4000, (prgChunks - 1) * 0x4000);
+		break;
+	}
+
+	if (ctrl.chrBankMode == 0) {
+		MapChrPages(0x0000, 0x2000, (chrLo & 0b1111'1110) * 0x1000, true);
+	} else {
+		MapChrPages(0x0000, 0x1000, chrLo * 0x1000, true);
+		MapChrPages(0x1000, 0x1000, chrHi * 0x1000, true);
 	}
-	return false;
 }
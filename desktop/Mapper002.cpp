@@ -1,25 +1,26 @@
 #include "Mapper002.h"
 
-Mapper002::Mapper002(int mapperNumber, int prgChunks, int chrChunks, std::vector<uint8_t>& prg, std::vector<uint8_t>& chr) :
+Mapper002::Mapper002(int mapperNumber, int prgChunks, int chrChunks, const std::vector<uint8_t>& prg, std::vector<uint8_t>& chr) :
 	Mapper(mapperNumber, prgChunks, chrChunks, prg, chr),
 	loPrgBank(0),
 	hiPrgBank(prgChunks - 1) {
+	UpdatePages();
 }
 
-Mapper002::Mapper002(Savestate& state, std::vector<uint8_t>& prg, std::vector<uint8_t>& chr) :
-	Mapper(state, prg, chr) {
+void Mapper002::LoadState(Savestate& state) {
+	Mapper::LoadState(state);
 	loPrgBank = state.Pop<uint8_t>();
-	hiPrgBank = prgChunks - 1;
+	UpdatePages();
 }
 
 void Mapper002::Reset() {
 	loPrgBank = 0;
+	UpdatePages();
 }
 
-Savestate Mapper002::SaveState() const {
-	Savestate state = Mapper::SaveState();
+void Mapper002::SaveState(Savestate& state) const {
+	Mapper::SaveState(state);
 	state.Push<uint8_t>(loPrgBank);
-	return state;
 }
 
 bool Mapper002::MapCpuRead(uint16_t& addr, uint8_t& data, bool readonly) {
@@ -35,7 +36,23 @@ bool Mapper002::MapCpuRead(uint16_t& addr, uint8_t& data, bool readonly) {
 }
 
 bool Mapper002::MapCpuWrite(uint16_t& addr, uint8_t data) {
-	if (addr >= 0x8000)
+	if (addr >= 0x8000) {
 		loPrgBank = data;
+		UpdatePages();
+	}
 	return false;
 }
+
+std::unique_ptr<Mapper> Mapper002::Clone() const {
+	return std::make_unique<Mapper002>(*this);
+}
+
+void Mapper002::CopyState(const Mapper& other) {
+	*this = static_cast<const Mapper002&>(other);
+	UpdatePages();
+}
+
+void Mapper002::UpdatePages() {
+	MapPrgPages(0x8000, 0x4000, 0x4000 * loPrgBank);
+	MapPrgPages(0xC000, 0x4000, 0x4000 * hiPrgBank);
+}
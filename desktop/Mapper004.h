@@ -1,23 +1,21 @@
 #pragma once
 #include "Mapper.h"
 
-class Mapper004 : public Mapper
+class Mapper004 final : public Mapper
 {
 public:
-	Mapper004(int mapperNumber, int prgChunks, int chrChunks, std::vector<uint8_t>& prg, std::vector<uint8_t>& chr);
-	Mapper004(Savestate& state, std::vector<uint8_t>& prg, std::vector<uint8_t>& chr);
+	Mapper004(int mapperNumber, int prgChunks, int chrChunks, const std::vector<uint8_t>& prg, std::vector<uint8_t>& chr);
 	bool MapCpuRead(uint16_t& addr, uint8_t& data, bool readonly = false) override;
 	bool MapCpuWrite(uint16_t& addr, uint8_t data) override;
-	bool MapPpuRead(uint16_t& addr, uint8_t& data, bool readonly = false) override;
-	bool MapPpuWrite(uint16_t& addr, uint8_t data) override;
-	Savestate SaveState() const override;
+	void SaveState(Savestate& state) const override;
+	void LoadState(Savestate& state) override;
 	MirrorMode GetMirrorMode() const override;
 	void Reset() override;
-	bool GetIrq() const override;
-	void ClearIrq() override;
 	void CountScanline() override;
+	std::unique_ptr<Mapper> Clone() const override;
+	void CopyState(const Mapper& other) override;
 private:
-	bool MapPpuAddr(uint16_t& addr, uint32_t& newAddr) const;
+	void UpdatePages();
 	int lastPrgBankNumber;
 	uint8_t regs[8];
 	union
@@ -35,6 +33,5 @@ private:
 	int irqReload;
 	int irqCounter;
 	bool irqEnabled;
-	bool irqState;
 	bool reloadPending;
 };
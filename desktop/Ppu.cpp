@@ -5,6 +5,7 @@
 Ppu::Ppu(Nes& nes, Cartridge* cart) :
 	nes(nes),
 	cart(cart),
+	mapper(cart->GetMapper()),
 	currentSpriteNumbers{}
 {
 	std::memset(palettes, 0x3F, sizeof(palettes));
@@ -15,13 +16,10 @@ Ppu::Ppu(Nes& nes, Cartridge* cart) :
 	status.reg = 0;
 	vramAddr.reg = 0;
 	tramAddr.reg = 0;
+	UpdatePages();
 }
 
-Ppu::Ppu(Nes& nes, Cartridge* cart, Savestate& state) :
-	nes(nes),
-	cart(cart),
-	currentSpriteNumbers{}
-{
+void Ppu::LoadState(Savestate& state) {
 	state.PopArray(nameTables, sizeof(nameTables));
 	state.PopArray(palettes, sizeof(palettes));
 
@@ -32,10 +30,11 @@ Ppu::Ppu(Nes& nes, Cartridge* cart, Savestate& state) :
 	nmi = state.Pop<uint8_t>();
 	oddFrame = state.Pop<uint8_t>();
 	isDrawing = state.Pop<uint8_t>();
-	colourOutput = state.Pop<uint8_t>();
+	// The last pixel's colour and background palette, which are only needed within a dot
+	state.Pop<uint8_t>();
+	state.Pop<uint8_t>();
+	state.Pop<uint8_t>();
 
-	bgPaletteNumber = state.Pop<uint8_t>();
-	bgPaletteIndex = state.Pop<uint8_t>();
 	bgNextTileID = state.Pop<uint8_t>();
 	patternAddr = state.Pop<uint16_t>();
 	bgPatternShifterLo = state.Pop<uint16_t>();
@@ -60,10 +59,13 @@ Ppu::Ppu(Nes& nes, Cartridge* cart, Savestate& state) :
 	state.PopArray(spritePatternShifterHi, sizeof(spritePatternShifterHi));
 	spriteCount = state.Pop<int32_t>();
 	sprite0Loaded = state.Pop<uint8_t>();
+	spriteDots = 0;
+	ClearCurrentSpriteNumbers();
+	BuildSpriteLine();
+	UpdatePages();
 }
 
-Savestate Ppu::SaveState() const {
-	Savestate state;
+void Ppu::SaveState(Savestate& state) const {
 	state.PushArray(nameTables, sizeof(nameTables));
 	state.PushArray(palettes, sizeof(palettes));
 
@@ -74,10 +76,11 @@ Savestate Ppu::SaveState() const {
 	state.Push<uint8_t>(nmi);
 	state.Push<uint8_t>(oddFrame);
 	state.Push<uint8_t>(isDrawing);
-	state.Push<uint8_t>(colourOutput);
+	// Kept in place of the last pixel's colour and background palette, so older savestates load
+	state.Push<uint8_t>(0);
+	state.Push<uint8_t>(0);
+	state.Push<uint8_t>(0);
 
-	state.Push<uint8_t>(bgPaletteNumber);
-	state.Push<uint8_t>(bgPaletteIndex);
 	state.Push<uint8_t>(bgNextTileID);
 	state.Push<uint16_t>(patternAddr);
 	state.Push<uint16_t>(bgPatternShifterLo);
@@ -97,18 +100,38 @@ Savestate Ppu::SaveState() const {
 	state.Push<uint8_t>(scrollFineX);
 	state.Push<uint8_t>(busData);
 
-	state.PushArray(currentSprites, sizeof(currentSprites));
-	state.PushArray(spritePatternShifterLo, sizeof(spritePatternShifterLo));
-	state.PushArray(spritePatternShifterHi, sizeof(spritePatternShifterHi));
+	ObjectAttributeMemory sprites[8];
+	uint8_t shifterLo[8];
+	uint8_t shifterHi[8];
+	AdvanceSprites(sprites, shifterLo, shifterHi);
+	state.PushArray(sprites, sizeof(sprites));
+	state.PushArray(shifterLo, sizeof(shifterLo));
+	state.PushArray(shifterHi, sizeof(shifterHi));
 	state.Push<int32_t>(spriteCount);
 	state.Push<uint8_t>(sprite0Loaded);
-	return state;
 }
 
 bool Ppu::IsBeginningFrame() const {
 	return dot == 1 && scanline == 0;
 }
 
+// Dots until the next one that can raise an NMI, clock the mapper's scanline counter, or begin a frame
+int Ppu::DotsUntilEvent() const {
+	if (scanline == 0 && dot == 0)
+		return 1;
+
+	int target;
+	if (scanline < DRAWABLE_HEIGHT && dot < 260)
+		target = scanline * DOT_COUNT + 259;
+	else if (scanline < DRAWABLE_HEIGHT - 1)
+		target = (scanline + 1) * DOT_COUNT + 259;
+	else if (scanline <= POST_RENDER_SCANLINE || (scanline == POST_RENDER_SCANLINE + 1 && dot <= 1))
+		target = (POST_RENDER_SCANLINE + 1) * DOT_COUNT + 1;
+	else
+		target = PRE_RENDER_SCANLINE * DOT_COUNT + DOT_COUNT - 1;
+	return target - (scanline * DOT_COUNT + dot) + 1;
+}
+
 const std::vector<uint8_t>& Ppu::GetPowerOffScreen() {
 	static std::vector<uint8_t> bytes = [] {
 		std::vector<uint8_t> bytes(Ppu::DRAWABLE_WIDTH * Ppu::DRAWABLE_HEIGHT);
@@ -128,6 +151,7 @@ void Ppu::Reset() {
 	oddFrame = false;
 	scanline = PRE_RENDER_SCANLINE;
 	dot = DOT_COUNT - 1;
+	UpdatePages();
 }
 
 void Ppu::Clock() {
@@ -148,6 +172,7 @@ void Ppu::Clock() {
 			sprite0Loaded = false;
 			std::memset(spritePatternShifterLo, 0, 8);
 			std::memset(spritePatternShifterHi, 0, 8);
+			BuildSpriteLine();
 		}
 		if ((dot >= 2 && dot < 258) || (dot >= 321 && dot < 338)) {
 			// Shift background and foreground shifters
@@ -155,57 +180,26 @@ void Ppu::Clock() {
 
 			switch ((dot - 1) % 8) {
 			case 0:
-			{
 				// Load current background shifters
 				LoadBackgroundShifters();
-				// Load next pattern table ID from nametable
-				bgNextTileID = PpuRead(0x2000 + vramAddr.addr);
+				FetchNametable();
 				break;
-			}
 			case 2:
-			{
-				// Load next attribute lo and hi bit for the next 8 pixels
-				uint16_t attrAddr = 0x23C0 + (vramAddr.reg & 0b0000'1100'0000'0000) + ((vramAddr.coarseY >> 2) << 3) + (vramAddr.coarseX >> 2);
-				uint8_t quadrant = ((vramAddr.coarseX & 2) >> 1) | (vramAddr.coarseY & 2);
-				uint8_t paletteNumber = (PpuRead(attrAddr) >> (2 * quadrant)) & 0b0011;
-				bgNextAttributeShifterLo = (paletteNumber & 0b01) * 0xFF;
-				bgNextAttributeShifterHi = ((paletteNumber & 0b10) >> 1) * 0xFF;
+				FetchAttribute();
 				break;
-			}
 			case 4:
-			{
-				// Load next 8 lo pattern bits
-				patternAddr = ctrl.backgroundPatternTable * 0x1000 + 16 * bgNextTileID + vramAddr.fineY;
-				bgNextPatternShifterLo = PpuRead(patternAddr);
+				FetchPatternLo();
 				break;
-			}
 			case 6:
-			{
-				// Load next 8 hi pattern bits
-				bgNextPatternShifterHi = PpuRead(patternAddr + 8);
+				FetchPatternHi();
 				break;
-			}
 			case 7:
-				if (mask.backgroundEnabled || mask.spriteEnabled) {
-					// Increment X
-					vramAddr.coarseX++;
-					if (vramAddr.coarseX == 0)
-						vramAddr.nametableX = ~vramAddr.nametableX;
-				}
+				IncrementX();
 				break;
 			}
 		}
-		if (dot == DRAWABLE_WIDTH && (mask.backgroundEnabled || mask.spriteEnabled)) {
-			// Increment Y
-			vramAddr.fineY++;
-			if (vramAddr.fineY == 0) {
-				vramAddr.coarseY++;
-				if (vramAddr.coarseY == 30) {
-					vramAddr.coarseY = 0;
-					vramAddr.nametableY = ~vramAddr.nametableY;
-				}
-			}
-		}
+		if (dot == DRAWABLE_WIDTH)
+			IncrementY();
 		if (dot == DRAWABLE_WIDTH + 1) {
 			// Load background shifters
 			LoadBackgroundShifters();
@@ -232,6 +226,8 @@ void Ppu::Clock() {
 			std::memset(spritePatternShifterHi, 0, 8);
 			// Sprite evaluation
 			status.spriteOverflow = nes.GetCurrentSprites(scanline, ctrl.spriteSize, currentSprites, spriteCount, sprite0Loaded, currentSpriteNumbers);
+			spriteDots = 0;
+			BuildSpriteLine();
 		}
 		if (dot >= DRAWABLE_WIDTH + 1 && dot < 321) {
 			// Clear oam address
@@ -261,23 +257,12 @@ void Ppu::Clock() {
 					addr |= (sprite.flipVertically ? (7 - yDiff) : yDiff) & 0b0111;
 				}
 
-				uint8_t loBits = PpuRead(addr);
-				uint8_t hiBits = PpuRead(addr + 8);
-
-				// Flip horizontally
-				if (sprite.flipHorizontally) {
-					// Flip bytes
-					loBits = (loBits & 0xF0) >> 4 | (loBits & 0x0F) << 4;
-					loBits = (loBits & 0xCC) >> 2 | (loBits & 0x33) << 2;
-					loBits = (loBits & 0xAA) >> 1 | (loBits & 0x55) << 1;
-					hiBits = (hiBits & 0xF0) >> 4 | (hiBits & 0x0F) << 4;
-					hiBits = (hiBits & 0xCC) >> 2 | (hiBits & 0x33) << 2;
-					hiBits = (hiBits & 0xAA) >> 1 | (hiBits & 0x55) << 1;
-				}
-
-				spritePatternShifterLo[i] = loBits;
-				spritePatternShifterHi[i] = hiBits;
+				// Flipped horizontally from the decoded row
+				const auto& row = mapper.GetChrRow(addr);
+				spritePatternShifterLo[i] = sprite.flipHorizontally ? row.flippedLo : row.lo;
+				spritePatternShifterHi[i] = sprite.flipHorizontally ? row.flippedHi : row.hi;
 			}
+			BuildSpriteLine();
 		}
 	}
 	if (scanline == POST_RENDER_SCANLINE + 1 && dot == 1) {
@@ -292,7 +277,7 @@ void Ppu::Clock() {
 	// Update column and scanline
 	dot++;
 	if (dot == 260 && scanline < 240 && (mask.backgroundEnabled || mask.spriteEnabled))
-		cart->GetMapper().CountScanline();
+		mapper.CountScanline();
 	if (dot == DOT_COUNT) {
 		// Scanline start
 		dot = 0;
@@ -308,32 +293,184 @@ void Ppu::Clock() {
 	}
 }
 
+// Clocks the PPU by the given number of dots. Nothing outside the PPU can change in between, so
+// visible scanlines that are covered in full are drawn in one go rather than dot by dot.
+void Ppu::Run(uint64_t dots) {
+	while (dots > 0) {
+		if (dot == 1 && scanline < DRAWABLE_HEIGHT && dots >= DRAWABLE_WIDTH) {
+			RenderScanline();
+			dots -= DRAWABLE_WIDTH;
+		} else {
+			Clock();
+			dots--;
+		}
+	}
+}
+
+// Equivalent to clocking dots 1 to 256 of a visible scanline
+void Ppu::RenderScanline() {
+	auto interleave = Mapper::ChrRow::Interleave;
+	isDrawing = true;
+
+	// Frames that are not drawn only need the pixels for sprite 0 hit
+	bool draw = nes.IsDrawingFrame();
+	bool sprite0Possible = sprite0Loaded && mask.backgroundEnabled && mask.spriteEnabled;
+	uint8_t colours[32];
+	if (draw) {
+		for (int i = 0; i < 32; i++)
+			colours[i] = PpuRead(0x3F00 + i);
+	}
+
+	// Background pixels and palette numbers at 2 bits each, mirroring the 16 bit shifters
+	uint32_t bgPixels = (uint32_t)interleave(bgPatternShifterLo >> 8, bgPatternShifterHi >> 8) << 16 | interleave(bgPatternShifterLo & 0xFF, bgPatternShifterHi & 0xFF);
+	uint32_t bgAttributes = (uint32_t)interleave(bgAttributeShifterLo >> 8, bgAttributeShifterHi >> 8) << 16 | interleave(bgAttributeShifterLo & 0xFF, bgAttributeShifterHi & 0xFF);
+	uint16_t nextPixels = 0;
+	uint16_t nextAttributes = 0;
+
+	uint8_t line[DRAWABLE_WIDTH];
+	for (int tile = 0; tile < DRAWABLE_WIDTH / 8; tile++) {
+		if (tile > 0) {
+			if (mask.backgroundEnabled) {
+				bgPatternShifterLo <<= 8;
+				bgPatternShifterHi <<= 8;
+				bgAttributeShifterLo <<= 8;
+				bgAttributeShifterHi <<= 8;
+			}
+			LoadBackgroundShifters();
+			FetchNametable();
+			bgPixels = bgPixels << 16 | nextPixels;
+			bgAttributes = bgAttributes << 16 | nextAttributes;
+		}
+
+		// The 8 pixels of this tile come from the top as the shifters move through them
+		uint16_t pixels = (bgPixels << (2 * scrollFineX)) >> 16;
+		uint16_t attributes = (bgAttributes << (2 * scrollFineX)) >> 16;
+
+		FetchAttribute();
+		nextAttributes = interleave(bgNextAttributeShifterLo, bgNextAttributeShifterHi);
+
+		// Both pattern planes at once
+		patternAddr = ctrl.backgroundPatternTable * 0x1000 + 16 * bgNextTileID + vramAddr.fineY;
+		const auto& row = mapper.GetChrRow(patternAddr);
+		bgNextPatternShifterLo = row.lo;
+		bgNextPatternShifterHi = row.hi;
+		nextPixels = row.pixels;
+
+		IncrementX();
+
+		if (!draw && (!sprite0Possible || status.sprite0Hit))
+			continue;
+		for (int i = 0; i < 8; i++) {
+			int x = tile * 8 + i;
+			int shift = 14 - 2 * i;
+			uint8_t bgPaletteNumber = 0;
+			uint8_t bgPaletteIndex = 0;
+			if (mask.backgroundEnabled) {
+				bgPaletteNumber = (attributes >> shift) & 0b0011;
+				bgPaletteIndex = (pixels >> shift) & 0b0011;
+			}
+			uint8_t fgPixel = spriteLine[mask.spriteEnabled ? spriteDots + x : spriteDots];
+			uint8_t fgPaletteIndex = fgPixel & 0b0011;
+
+			// Sprite 0 hit
+			if (bgPaletteIndex && fgPaletteIndex && sprite0Loaded && (fgPixel & 0x40) && mask.backgroundEnabled && mask.spriteEnabled)
+				status.sprite0Hit = true;
+			if (!draw)
+				continue;
+
+			// Final output
+			if ((x < 8 && !mask.drawLeftBackground) || !nes.masterBg)
+				bgPaletteIndex = 0;
+			if ((x < 8 && !mask.drawLeftSprite) || !nes.masterFg)
+				fgPaletteIndex = 0;
+
+			if (fgPaletteIndex && (!bgPaletteIndex || !(fgPixel & 0x20)))
+				line[x] = colours[fgPixel & 0x1F];
+			else if (bgPaletteIndex)
+				line[x] = colours[bgPaletteNumber * 4 + bgPaletteIndex];
+			else
+				line[x] = colours[0];
+		}
+	}
+	if (mask.backgroundEnabled) {
+		bgPatternShifterLo <<= 7;
+		bgPatternShifterHi <<= 7;
+		bgAttributeShifterLo <<= 7;
+		bgAttributeShifterHi <<= 7;
+	}
+	IncrementY();
+	if (mask.spriteEnabled)
+		spriteDots += DRAWABLE_WIDTH - 1;
+
+	if (draw)
+		nes.DrawScanline(scanline, line);
+	dot = DRAWABLE_WIDTH + 1;
+}
+
+void Ppu::BuildSpriteLine() {
+	std::memset(spriteLine, 0, sizeof(spriteLine));
+	for (int i = spriteCount - 1; i >= 0; i--) {
+		const auto& sprite = currentSprites[i];
+		uint8_t flags = ((sprite.palette + 4) << 2) | (sprite.priority << 5) | ((i == 0) << 6);
+		uint16_t pixels = Mapper::ChrRow::Interleave(spritePatternShifterLo[i], spritePatternShifterHi[i]);
+		for (int col = 0; col < 8 && sprite.x + col < DRAWABLE_WIDTH; col++) {
+			uint8_t index = (pixels >> (14 - 2 * col)) & 0b0011;
+			if (index)
+				spriteLine[sprite.x + col] = flags | index;
+		}
+	}
+}
+
+// Sprites and shifters as clocking them one dot at a time would have left them
+void Ppu::AdvanceSprites(ObjectAttributeMemory sprites[8], uint8_t shifterLo[8], uint8_t shifterHi[8]) const {
+	std::memcpy(sprites, currentSprites, sizeof(currentSprites));
+	std::memcpy(shifterLo, spritePatternShifterLo, sizeof(spritePatternShifterLo));
+	std::memcpy(shifterHi, spritePatternShifterHi, sizeof(spritePatternShifterHi));
+	for (int i = 0; i < spriteCount; i++) {
+		int shifts = spriteDots - sprites[i].x;
+		sprites[i].x = shifts < 0 ? -shifts : 0;
+		if (shifts > 0) {
+			shifterLo[i] = shifts < 8 ? shifterLo[i] << shifts : 0;
+			shifterHi[i] = shifts < 8 ? shifterHi[i] << shifts : 0;
+		}
+	}
+}
+
 void Ppu::ClearCurrentSpriteNumbers() {
 	std::memset(currentSpriteNumbers.data(), false, currentSpriteNumbers.size());
 }
 
-uint8_t Ppu::PpuRead(uint16_t addr, bool readonly) {
+void Ppu::UpdatePages() {
+	for (int i = 0; i < 8; i++)
+		pages[i] = mapper.GetChrPage(i * 0x400);
+
+	int tables[4] = {};
+	switch (cart->GetMirrorMode()) {
+	case MirrorMode::Vertical:
+		tables[1] = tables[3] = 1;
+		break;
+	case MirrorMode::Horizontal:
+		tables[2] = tables[3] = 1;
+		break;
+	case MirrorMode::OneScreenLo:
+		break;
+	case MirrorMode::OneScreenHi:
+		tables[0] = tables[1] = tables[2] = tables[3] = 1;
+		break;
+	default:
+		break;
+	}
+	for (int i = 0; i < 4; i++)
+		pages[8 + i] = pages[12 + i] = nameTables[tables[i]];
+}
+
+uint8_t Ppu::PpuRead(uint16_t addr) {
 	addr &= 0b0011'1111'1111'1111;
 	uint8_t data = 0;
-	if (cart->PpuRead(addr, data, readonly)) {
-	} else if (addr >= 0x2000 && addr < 0x3F00) {
-		switch (cart->GetMirrorMode()) {
-		case MirrorMode::Vertical:
-			data = nameTables[(bool)(addr & 0b0100'0000'0000)][addr & 0b0011'1111'1111];
-			break;
-		case MirrorMode::Horizontal:
-			data = nameTables[(bool)(addr & 0b1000'0000'0000)][addr & 0b0011'1111'1111];
-			break;
-		case MirrorMode::OneScreenLo:
-			data = nameTables[0][addr & 0b0011'1111'1111];
-			break;
-		case MirrorMode::OneScreenHi:
-			data = nameTables[1][addr & 0b0011'1111'1111];
-			break;
-		default:
-			break;
-		}
-	} else if (addr >= 0x3F00) {
+	if (addr < 0x3F00) {
+		if (const uint8_t* page = pages[addr >> 10])
+			data = page[addr & 0b0011'1111'1111];
+	} else {
 		addr &= 0b0001'1111;
 		if ((addr & 0b0011) || addr < 0x10)
 			data = palettes[addr >> 2][addr & 0b0011];
@@ -348,25 +485,13 @@ uint8_t Ppu::PpuRead(uint16_t addr, bool readonly) {
 
 void Ppu::PpuWrite(uint16_t addr, uint8_t data) {
 	addr &= 0b0011'1111'1111'1111;
-	if (cart->PpuWrite(addr, data)) {
-	} else if (addr >= 0x2000 && addr < 0x3F00) {
-		switch (cart->GetMirrorMode()) {
-		case MirrorMode::Vertical:
-			nameTables[(bool)(addr & 0b0100'0000'0000)][addr & 0b0011'1111'1111] = data;
-			break;
-		case MirrorMode::Horizontal:
-			nameTables[(bool)(addr & 0b1000'0000'0000)][addr & 0b0011'1111'1111] = data;
-			break;
-		case MirrorMode::OneScreenLo:
-			nameTables[0][addr & 0b0011'1111'1111] = data;
-			break;
-		case MirrorMode::OneScreenHi:
-			nameTables[1][addr & 0b0011'1111'1111] = data;
-			break;
-		default:
-			break;
-		}
-	} else if (addr >= 0x3F00) {
+	if (addr < 0x2000) {
+		// Through the mapper, which drops any decoded copy of the row
+		mapper.WriteChr(addr, data);
+	} else if (addr < 0x3F00) {
+		if (uint8_t* page = pages[addr >> 10])
+			page[addr & 0b0011'1111'1111] = data;
+	} else {
 		addr &= 0b0001'1111;
 		if ((addr & 0b0011) || addr < 0x10)
 			palettes[addr >> 2][addr & 0b0011] = data;
@@ -396,7 +521,7 @@ uint8_t Ppu::ReadFromCpu(uint16_t addr, bool readonly) {
 		case 6: // PPU Address (W)
 			break;
 		case 7: // PPU Data (RW)
-			data = PpuRead(vramAddr.reg, true);
+			data = PpuRead(vramAddr.reg);
 			break;
 		}
 	} else {
@@ -486,6 +611,52 @@ bool Ppu::CheckNmi() {
 	return state;
 }
 
+void Ppu::FetchNametable() {
+	// Load next pattern table ID from nametable
+	bgNextTileID = PpuRead(0x2000 + vramAddr.addr);
+}
+
+void Ppu::FetchAttribute() {
+	// Load next attribute lo and hi bit for the next 8 pixels
+	uint16_t attrAddr = 0x23C0 + (vramAddr.reg & 0b0000'1100'0000'0000) + ((vramAddr.coarseY >> 2) << 3) + (vramAddr.coarseX >> 2);
+	uint8_t quadrant = ((vramAddr.coarseX & 2) >> 1) | (vramAddr.coarseY & 2);
+	uint8_t paletteNumber = (PpuRead(attrAddr) >> (2 * quadrant)) & 0b0011;
+	bgNextAttributeShifterLo = (paletteNumber & 0b01) * 0xFF;
+	bgNextAttributeShifterHi = ((paletteNumber & 0b10) >> 1) * 0xFF;
+}
+
+void Ppu::FetchPatternLo() {
+	// Load next 8 lo pattern bits
+	patternAddr = ctrl.backgroundPatternTable * 0x1000 + 16 * bgNextTileID + vramAddr.fineY;
+	bgNextPatternShifterLo = PpuRead(patternAddr);
+}
+
+void Ppu::FetchPatternHi() {
+	// Load next 8 hi pattern bits
+	bgNextPatternShifterHi = PpuRead(patternAddr + 8);
+}
+
+void Ppu::IncrementX() {
+	if (mask.backgroundEnabled || mask.spriteEnabled) {
+		vramAddr.coarseX++;
+		if (vramAddr.coarseX == 0)
+			vramAddr.nametableX = ~vramAddr.nametableX;
+	}
+}
+
+void Ppu::IncrementY() {
+	if (mask.backgroundEnabled || mask.spriteEnabled) {
+		vramAddr.fineY++;
+		if (vramAddr.fineY == 0) {
+			vramAddr.coarseY++;
+			if (vramAddr.coarseY == 30) {
+				vramAddr.coarseY = 0;
+				vramAddr.nametableY = ~vramAddr.nametableY;
+			}
+		}
+	}
+}
+
 void Ppu::LoadBackgroundShifters() {
 	bgAttributeShifterLo = bgNextAttributeShifterLo | (bgAttributeShifterLo & 0xFF00);
 	bgAttributeShifterHi = bgNextAttributeShifterHi | (bgAttributeShifterHi & 0xFF00);
@@ -503,20 +674,14 @@ void Ppu::UpdateShifters() {
 	}
 
 	// Foreground
-	if (dot >= 1 && dot < 258 && mask.spriteEnabled) {
-		for (int i = 0; i < spriteCount; i++) {
-			if (currentSprites[i].x > 0) {
-				currentSprites[i].x--;
-			} else {
-				spritePatternShifterLo[i] <<= 1;
-				spritePatternShifterHi[i] <<= 1;
-			}
-		}
-	}
+	if (dot >= 1 && dot < 258 && mask.spriteEnabled)
+		spriteDots++;
 }
 
 void Ppu::OutputColour() {
 	// Background
+	uint8_t bgPaletteNumber = 0;
+	uint8_t bgPaletteIndex = 0;
 	if (mask.backgroundEnabled) {
 		int shift = 15 - scrollFineX;
 		uint16_t bitmask = 1 << shift;
@@ -524,35 +689,22 @@ void Ppu::OutputColour() {
 		bgPaletteNumber |= ((bgAttributeShifterHi & bitmask) >> shift) << 1;
 		bgPaletteIndex = (bgPatternShifterLo & bitmask) >> shift;
 		bgPaletteIndex |= ((bgPatternShifterHi & bitmask) >> shift) << 1;
-	} else {
-		bgPaletteNumber = bgPaletteIndex = 0;
 	}
 
 	// Foreground
-	uint8_t fgPaletteNumber = 0;
-	uint8_t fgPaletteIndex = 0;
-	bool fgPriority;
-	bool isSprite0 = false;
-	for (int i = 0; i < spriteCount; i++) {
-		const auto& sprite = currentSprites[i];
-		if (sprite.x == 0) {
-			uint8_t loBit = spritePatternShifterLo[i] >> 7;
-			uint8_t hiBit = spritePatternShifterHi[i] >> 7;
-			fgPaletteIndex = (hiBit << 1) | loBit;
-			fgPaletteNumber = sprite.palette + 4;
-			if (fgPaletteIndex) {
-				if (i == 0)
-					isSprite0 = true;
-				fgPriority = sprite.priority;
-				break;
-			}
-		}
-	}
+	uint8_t fgPixel = spriteLine[spriteDots];
+	uint8_t fgPaletteNumber = (fgPixel & 0x1F) >> 2;
+	uint8_t fgPaletteIndex = fgPixel & 0b0011;
+	bool fgPriority = fgPixel & 0x20;
+	bool isSprite0 = fgPixel & 0x40;
 
 	// Sprite 0 hit
 	if (bgPaletteIndex && fgPaletteIndex && sprite0Loaded && isSprite0 && mask.backgroundEnabled && mask.spriteEnabled)
 		status.sprite0Hit = true;
 
+	if (!isDrawing || !nes.IsDrawingFrame())
+		return;
+
 	// Final output
 	uint8_t paletteNumber;
 	uint8_t paletteIndex;
@@ -583,8 +735,5 @@ void Ppu::OutputColour() {
 		}
 	}
 
-	if (isDrawing) {
-		colourOutput = PpuRead(0x3F00 + paletteNumber * 4 + paletteIndex);
-		nes.DrawPixel(dot - 1, scanline, colourOutput);
-	}
+	nes.DrawPixel(dot - 1, scanline, PpuRead(0x3F00 + paletteNumber * 4 + paletteIndex));
 }
@@ -31,14 +31,17 @@ class Ppu
 {
 public:
 	Ppu(Nes& nes, Cartridge* cart);
-	Ppu(Nes& nes, Cartridge* cart, Savestate& state);
 	void Reset();
 	void Clock();
+	void Run(uint64_t dots);
 	void WriteFromCpu(uint16_t addr, uint8_t data);
 	uint8_t ReadFromCpu(uint16_t addr, bool readonly = false);
 	bool CheckNmi();
 	bool IsBeginningFrame() const;
-	Savestate SaveState() const;
+	int DotsUntilEvent() const;
+	void UpdatePages();
+	void SaveState(Savestate& state) const;
+	void LoadState(Savestate& state);
 	void ClearCurrentSpriteNumbers();
 	static constexpr int DRAWABLE_WIDTH = 256;
 	static constexpr int DRAWABLE_HEIGHT = 240;
@@ -48,17 +51,29 @@ public:
 private:
 	// Private bus
 	void PpuWrite(uint16_t addr, uint8_t data);
-	uint8_t PpuRead(uint16_t addr, bool readonly = false);
+	uint8_t PpuRead(uint16_t addr);
 
 	static constexpr int PRE_RENDER_SCANLINE = SCANLINE_COUNT - 1;
 	static constexpr int POST_RENDER_SCANLINE = DRAWABLE_HEIGHT;
 
 	Nes& nes;
 	Cartridge* const cart;
+	Mapper& mapper;
 	uint8_t nameTables[2][0x400];
 	uint8_t palettes[8][4];
 
+	// 1KB pages below the palettes, with $3000-$3EFF mirroring $2000-$2EFF. Refreshed by
+	// UpdatePages whenever the mapper may have switched banks or mirroring.
+	std::array<uint8_t*, 16> pages{};
+
 	void OutputColour();
+	void RenderScanline();
+	void FetchNametable();
+	void FetchAttribute();
+	void FetchPatternLo();
+	void FetchPatternHi();
+	void IncrementX();
+	void IncrementY();
 	void LoadBackgroundShifters();
 	void UpdateShifters();
 	int dot = DOT_COUNT - 1;
@@ -68,12 +83,9 @@ private:
 	bool nmi = false;
 	bool oddFrame = false;
 	bool isDrawing = false;
-	uint8_t colourOutput = 0x3F;
 	uint8_t busData = 0;
 
 	// Background data
-	uint8_t bgPaletteNumber = 0;
-	uint8_t bgPaletteIndex = 0;
 	uint8_t bgNextTileID = 0;
 	uint16_t patternAddr = 0;
 	uint16_t bgPatternShifterLo = 0;
@@ -159,4 +171,13 @@ private:
 	bool sprite0Loaded = false;
 	uint8_t spritePatternShifterLo[8];
 	uint8_t spritePatternShifterHi[8];
+
+	// Every sprite either counts down x or shifts on each clocked dot, so what they draw only
+	// depends on how many dots they've been clocked since loading. currentSprites and the shifters
+	// keep their values from loading, and are brought up to date when saving.
+	void BuildSpriteLine();
+	void AdvanceSprites(ObjectAttributeMemory sprites[8], uint8_t shifterLo[8], uint8_t shifterHi[8]) const;
+	int spriteDots = 0;
+	// Palette address | priority << 5 | sprite 0 << 6 after each number of dots, 0 if transparent
+	uint8_t spriteLine[DRAWABLE_WIDTH] = {};
 };
@@ -0,0 +1,35 @@
+#pragma once
+#include <array>
+#include <cstdint>
+#include <vector>
+
+// Converts a stream of samples to another rate with a polyphase windowed sinc, carrying its
+// position and the last samples from one block of input to the next. Used to play the audio
+// of emulation running at other than full speed at the output rate.
+class Resampler
+{
+public:
+	static constexpr int TAPS = 16;
+	static constexpr int PHASES = 64;
+
+	Resampler();
+
+	// Input samples per output sample. Above 1 the cut off is lowered with it, so nothing above
+	// the output's Nyquist frequency folds back.
+	void SetRatio(double ratio);
+
+	// Appends the input resampled to out. Output lags the input by half the taps.
+	void Process(const std::vector<int16_t>& in, std::vector<int16_t>& out);
+private:
+	void BuildKernel();
+
+	double ratio = 1.0;
+	// Ratio and the position of the next output sample in samples of input from the start of
+	// the history, in fixed point
+	uint64_t step;
+	uint64_t position;
+	// Input from the last samples still needed on, in which the kernel is centred
+	std::vector<int16_t> history;
+	// Taps in 1 / (1 << KERNEL_BITS), for each phase from 0 to PHASES inclusive
+	std::array<std::array<int16_t, TAPS>, PHASES + 1> kernel{};
+};
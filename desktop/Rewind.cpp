@@ -0,0 +1,152 @@
+#include "Rewind.h"
+#include <cstring>
+
+Rewind::Rewind(size_t memoryBudget) :
+	memoryBudget(memoryBudget) {
+}
+
+void Rewind::Push(const std::vector<uint8_t>& state) {
+	// A different cartridge, as states of one cartridge are all the same size
+	if (hasNewest && state.size() != newest.size())
+		Clear();
+
+	if (hasNewest) {
+		spare.clear();
+		size_t last = 0;
+		EncodeDelta(state.data(), newest.data(), 0, state.size(), last, spare);
+		PushDelta();
+	}
+	newest = state;
+	hasNewest = true;
+	newestEpoch = 0;
+}
+
+// Only the bytes rewritten in the newest state are compared, and a save that comes out a
+// different size, or in a different layout, is redone whole
+void Rewind::Push(const std::function<uint32_t(Savestate&)>& save) {
+	if (hasNewest && newestEpoch) {
+		Savestate state(newest, newestEpoch);
+		uint32_t epoch = save(state);
+		if (state.MatchedLayout()) {
+			spare.clear();
+			size_t last = 0;
+			const uint8_t* old = state.GetReplaced().data();
+			for (const auto& rewrite : state.GetRewrites()) {
+				EncodeDelta(newest.data() + rewrite.offset, old, rewrite.offset, rewrite.length, last, spare);
+				old += rewrite.length;
+			}
+			PushDelta();
+			newestEpoch = epoch;
+			return;
+		}
+		state.Undo();
+	}
+
+	Savestate state;
+	uint32_t epoch = save(state);
+	Push(state.GetBuffer());
+	newestEpoch = epoch;
+}
+
+void Rewind::PushDelta() {
+	deltaBytes += spare.size();
+	deltas.push_back(std::move(spare));
+	spare = {};
+
+	while (GetMemoryUsage() > memoryBudget && !deltas.empty()) {
+		deltaBytes -= deltas.front().size();
+		spare = std::move(deltas.front());
+		deltas.pop_front();
+	}
+}
+
+bool Rewind::Pop(std::vector<uint8_t>& state) {
+	if (!hasNewest)
+		return false;
+
+	state = newest;
+	newestEpoch = 0;
+	if (deltas.empty()) {
+		hasNewest = false;
+	} else {
+		ApplyDelta(deltas.back(), newest);
+		deltaBytes -= deltas.back().size();
+		spare = std::move(deltas.back());
+		deltas.pop_back();
+	}
+	return true;
+}
+
+void Rewind::Clear() {
+	newest.clear();
+	hasNewest = false;
+	newestEpoch = 0;
+	deltas.clear();
+	deltaBytes = 0;
+}
+
+size_t Rewind::GetMemoryUsage() const {
+	return newest.size() + deltaBytes;
+}
+
+size_t Rewind::size() const {
+	return hasNewest + deltas.size();
+}
+
+// Alternating runs of unchanged and changed bytes, each starting with its length as a 7 bit
+// varint, with the changed bytes stored as a ^ b. Trailing unchanged bytes are left out.
+// Appends the runs for the bytes of the states at offset, where last is the end of the previous
+// changed run, so a delta can be encoded a stretch at a time.
+void Rewind::EncodeDelta(const uint8_t* a, const uint8_t* b, size_t offset, size_t size, size_t& last, std::vector<uint8_t>& delta) {
+	auto pushLength = [&](size_t length) {
+		for (; length >= 0x80; length >>= 7)
+			delta.push_back((uint8_t)length | 0x80);
+		delta.push_back((uint8_t)length);
+	};
+
+	size_t i = 0;
+	while (i < size) {
+		while (i + 8 <= size && std::memcmp(&a[i], &b[i], 8) == 0)
+			i += 8;
+		while (i < size && a[i] == b[i])
+			i++;
+		if (i == size)
+			break;
+
+		// A changed run only ends at a few unchanged bytes in a row, as each run costs its lengths
+		size_t changed = i;
+		int same = 0;
+		for (; i < size && same < 4; i++)
+			same = a[i] == b[i] ? same + 1 : 0;
+		i -= same;
+
+		pushLength(offset + changed - last);
+		pushLength(i - changed);
+		for (size_t j = changed; j < i; j++)
+			delta.push_back(a[j] ^ b[j]);
+		last = offset + i;
+	}
+}
+
+void Rewind::ApplyDelta(const std::vector<uint8_t>& delta, std::vector<uint8_t>& state) {
+	size_t pos = 0;
+	auto readLength = [&] {
+		size_t length = 0;
+		int shift = 0;
+		uint8_t byte;
+		do {
+			byte = delta[pos++];
+			length |= (size_t)(byte & 0x7F) << shift;
+			shift += 7;
+		} while (byte & 0x80);
+		return length;
+	};
+
+	size_t i = 0;
+	while (pos < delta.size()) {
+		i += readLength();
+		size_t length = readLength();
+		for (size_t j = 0; j < length; j++)
+			state[i++] ^= delta[pos++];
+	}
+}
@@ -0,0 +1,35 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <vector>
+#include "Savestate.h"
+
+// Recent savestates, kept within a memory budget. The newest state is kept whole, and each
+// older one as its difference to the state after it, run-length encoded as most of it is
+// unchanged. Popping undoes the newest difference, and the oldest are dropped to stay in budget.
+class Rewind
+{
+public:
+	Rewind(size_t memoryBudget);
+	void Push(const std::vector<uint8_t>& state);
+	// Saves with save(state), which is passed a savestate writing over the newest state once that
+	// was saved this way, in the epoch it returned, see Nes::SaveStateSince
+	void Push(const std::function<uint32_t(Savestate&)>& save);
+	bool Pop(std::vector<uint8_t>& state);
+	void Clear();
+	size_t GetMemoryUsage() const;
+	size_t size() const;
+	size_t memoryBudget;
+private:
+	static void EncodeDelta(const uint8_t* a, const uint8_t* b, size_t offset, size_t size, size_t& last, std::vector<uint8_t>& delta);
+	static void ApplyDelta(const std::vector<uint8_t>& delta, std::vector<uint8_t>& state);
+	void PushDelta();
+	std::vector<uint8_t> newest;
+	bool hasNewest = false;
+	uint32_t newestEpoch = 0;
+	std::deque<std::vector<uint8_t>> deltas;
+	size_t deltaBytes = 0;
+	std::vector<uint8_t> spare;
+};